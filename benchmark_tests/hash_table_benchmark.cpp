@@ -1,10 +1,16 @@
 #include <benchmark/benchmark.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
 
 #include "hash_table.h"
 
@@ -77,7 +83,8 @@ struct HashTableFixture : public benchmark::Fixture {
     hash_table.find(key);
   }
 
-  void Lookup(HashTable<int32_t, int32_t>& hash_table, int32_t key, int32_t& value) {
+  template<typename... Params>
+  void Lookup(HashTable<int32_t, int32_t, Params...>& hash_table, int32_t key, int32_t& value) {
     hash_table.Lookup(key, value);
   }
 
@@ -86,7 +93,8 @@ struct HashTableFixture : public benchmark::Fixture {
     hash_table.emplace(key, value);
   }
 
-  void Insert(HashTable<int32_t, int32_t>& hash_table, int32_t key, int32_t value) {
+  template<typename... Params>
+  void Insert(HashTable<int32_t, int32_t, Params...>& hash_table, int32_t key, int32_t value) {
     hash_table.Insert(key, value);
   }
 
@@ -95,7 +103,8 @@ struct HashTableFixture : public benchmark::Fixture {
     hash_table.erase(key);
   }
 
-  void Remove(HashTable<int32_t, int32_t>& hash_table, int32_t key) {
+  template<typename... Params>
+  void Remove(HashTable<int32_t, int32_t, Params...>& hash_table, int32_t key) {
     hash_table.Remove(key);
   }
 
@@ -103,6 +112,19 @@ struct HashTableFixture : public benchmark::Fixture {
   std::mutex mutex;
 };
 
+// Same allocator as HashTable<int32_t, int32_t>, so that only the compared
+// parameter differs.
+template<typename Reclamation>
+using ReclaimedHashTable =
+    HashTable<int32_t, int32_t, ChainingBackend,
+              std::allocator<std::pair<const int32_t, int32_t>>, Reclamation>;
+
+using StatsHashTable =
+    HashTable<int32_t, int32_t, ChainingBackend,
+              std::allocator<std::pair<const int32_t, int32_t>>, RCUReclamation,
+              std::hash<int32_t>, std::equal_to<int32_t>, PowerOfTwoGrowth,
+              CollectStats>;
+
 template<typename HashTable>
 void HashTableFixture<HashTable>::ManyLookups(benchmark::State& state, bool measure_lookup,
                                               bool measure_insert, bool measure_remove) {
@@ -214,6 +236,141 @@ BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
       /*measure_remove =*/ true);
 }
 
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureLookupOpenAddressingHashTable,
+                            HashTable<int32_t, int32_t, OpenAddressingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ true,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureInsertOpenAddressingHashTable,
+                            HashTable<int32_t, int32_t, OpenAddressingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ true,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureRemoveOpenAddressingHashTable,
+                            HashTable<int32_t, int32_t, OpenAddressingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ true);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureLookupEpochHashTable,
+                            ReclaimedHashTable<EpochReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ true,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureInsertEpochHashTable,
+                            ReclaimedHashTable<EpochReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ true,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureRemoveEpochHashTable,
+                            ReclaimedHashTable<EpochReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ true);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureLookupHazardPointerHashTable,
+                            ReclaimedHashTable<HazardPointerReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ true,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureInsertHazardPointerHashTable,
+                            ReclaimedHashTable<HazardPointerReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ true,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureRemoveHazardPointerHashTable,
+                            ReclaimedHashTable<HazardPointerReclamation>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ true);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureLookupLockFreeHashTable,
+                            HashTable<int32_t, int32_t, LockFreeChainingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ true,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureInsertLockFreeHashTable,
+                            HashTable<int32_t, int32_t, LockFreeChainingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ true,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureRemoveLockFreeHashTable,
+                            HashTable<int32_t, int32_t, LockFreeChainingBackend>)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ true);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureLookupStatsHashTable,
+                            StatsHashTable)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ true,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureInsertStatsHashTable,
+                            StatsHashTable)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ true,
+      /*measure_remove =*/ false);
+}
+
+BENCHMARK_TEMPLATE_DEFINE_F(HashTableFixture,
+                            MeasureRemoveStatsHashTable,
+                            StatsHashTable)(benchmark::State& state) {
+  ManyLookups(state,
+      /*measure_lookup =*/ false,
+      /*measure_insert =*/ false,
+      /*measure_remove =*/ true);
+}
+
 BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertStdHashTable)
 ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
 BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupStdHashTable)
@@ -227,4 +384,380 @@ BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupMyHashTable)
     ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
 BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveMyHashTable)
     ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertOpenAddressingHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupOpenAddressingHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveOpenAddressingHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertEpochHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupEpochHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveEpochHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertHazardPointerHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupHazardPointerHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveHazardPointerHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertLockFreeHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupLockFreeHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveLockFreeHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureInsertStatsHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureLookupStatsHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableFixture, MeasureRemoveStatsHashTable)
+    ->Args({1, 1, 1})->Args({1, 2, 1})->Args({2, 2, 2})->Args({6, 2, 2})->UseRealTime();
+
+// Looks up batches of state.range(0) random keys in a table of a million
+// elements, which is much larger than the caches, either one key at a time
+// or, if kMultiLookup, with MultiLookup.
+template<typename Backend, bool kMultiLookup>
+void LookupBatches(benchmark::State& state) {
+  HashTable<int32_t, int32_t, Backend> hash_table(kHashTableSize);
+  for (int32_t i = kMinNumber; i <= kMaxNumber; i++) {
+    hash_table.Insert(i, i);
+  }
+
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<int32_t> distribution(kMinNumber, kMaxNumber);
+  std::vector<int32_t> keys(kMaxAddedNumbers);
+  for (auto& key : keys) {
+    key = distribution(generator);
+  }
+
+  size_t batch_size = state.range(0);
+  std::vector<int32_t> values(batch_size);
+  std::unique_ptr<bool[]> found(new bool[batch_size]);
+  size_t begin = 0;
+  for (auto _ : state) {
+    if (begin + batch_size > keys.size()) {
+      begin = 0;
+    }
+    if (kMultiLookup) {
+      hash_table.MultiLookup(&keys[begin], batch_size, values.data(),
+                             found.get());
+    } else {
+      for (size_t i = 0; i < batch_size; i++) {
+        found[i] = hash_table.Lookup(keys[begin + i], values[i]);
+      }
+    }
+    benchmark::ClobberMemory();
+    begin += batch_size;
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+BENCHMARK_TEMPLATE(LookupBatches, ChainingBackend, false)->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(LookupBatches, ChainingBackend, true)->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(LookupBatches, LockFreeChainingBackend, false)
+    ->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(LookupBatches, LockFreeChainingBackend, true)
+    ->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(LookupBatches, OpenAddressingBackend, false)
+    ->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(LookupBatches, OpenAddressingBackend, true)
+    ->Arg(64)->Arg(512);
+
+// Fills a table that starts with a single bucket from state.range(0)
+// threads, which share the resizes on the way, up to state.range(1)
+// elements.
+template<typename Backend>
+void FillWithThreads(benchmark::State& state) {
+  size_t thread_count = state.range(0);
+  int32_t element_count = state.range(1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto hash_table =
+        std::make_unique<HashTable<int32_t, int32_t, Backend>>(kHashTableSize);
+    state.ResumeTiming();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; t++) {
+      threads.emplace_back([&, t] {
+        for (int32_t i = t; i < element_count; i += thread_count) {
+          hash_table->Insert(i, i);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    state.PauseTiming();
+    hash_table.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * element_count);
+}
+
+BENCHMARK_TEMPLATE(FillWithThreads, ChainingBackend)
+    ->Args({1, 1 << 22})->Args({2, 1 << 22})->Args({4, 1 << 22})
+    ->Args({8, 1 << 22})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(FillWithThreads, LockFreeChainingBackend)
+    ->Args({1, 1 << 22})->Args({2, 1 << 22})->Args({4, 1 << 22})
+    ->Args({8, 1 << 22})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+enum class LoadMethod {
+  kInsert,
+  kReserveAndInsert,
+  kBulkConstructor,
+  kSnapshot,
+};
+
+// Loads state.range(0) elements into a new table that starts with a single
+// bucket, as a service does at startup.
+template<typename Backend, LoadMethod kMethod>
+void LoadAtStartup(benchmark::State& state) {
+  std::vector<std::pair<int32_t, int32_t>> pairs;
+  for (int32_t i = 0; i < state.range(0); i++) {
+    pairs.emplace_back(i, i);
+  }
+  using Table = HashTable<int32_t, int32_t, Backend>;
+  const std::string snapshot_path = "load_at_startup.snapshot";
+  if (kMethod == LoadMethod::kSnapshot) {
+    Table(pairs.begin(), pairs.end()).SaveSnapshot(snapshot_path);
+  }
+  for (auto _ : state) {
+    std::unique_ptr<Table> hash_table;
+    if (kMethod == LoadMethod::kBulkConstructor) {
+      hash_table = std::make_unique<Table>(pairs.begin(), pairs.end());
+    } else if (kMethod == LoadMethod::kSnapshot) {
+      hash_table = Table::LoadSnapshot(snapshot_path);
+    } else {
+      hash_table = std::make_unique<Table>(kHashTableSize);
+      if (kMethod == LoadMethod::kReserveAndInsert) {
+        hash_table->Reserve(pairs.size());
+      }
+      for (const auto& [key, value] : pairs) {
+        hash_table->Insert(key, value);
+      }
+    }
+    state.PauseTiming();
+    hash_table.reset();
+    state.ResumeTiming();
+  }
+  if (kMethod == LoadMethod::kSnapshot) {
+    std::remove(snapshot_path.c_str());
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+BENCHMARK_TEMPLATE(LoadAtStartup, ChainingBackend, LoadMethod::kInsert)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, ChainingBackend,
+                   LoadMethod::kReserveAndInsert)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, ChainingBackend,
+                   LoadMethod::kBulkConstructor)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, ChainingBackend, LoadMethod::kSnapshot)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, LockFreeChainingBackend,
+                   LoadMethod::kInsert)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, LockFreeChainingBackend,
+                   LoadMethod::kBulkConstructor)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, LockFreeChainingBackend,
+                   LoadMethod::kSnapshot)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, OpenAddressingBackend, LoadMethod::kInsert)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, OpenAddressingBackend,
+                   LoadMethod::kBulkConstructor)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LoadAtStartup, OpenAddressingBackend, LoadMethod::kSnapshot)
+    ->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+
+namespace {
+
+// Latencies in nanoseconds, bucketed like an HDR histogram: values below
+// 2^(kPrecisionBits + 1) are kept exactly, larger ones in 2^kPrecisionBits
+// buckets per power of two, so a reported percentile is at most 1/32 above
+// the true one.
+class LatencyHistogram {
+ public:
+  void Record(uint64_t latency) {
+    ++counts_[Index(latency)];
+    ++count_;
+    max_ = std::max(max_, latency);
+  }
+
+  // The latency that a `quantile` of the operations did not exceed.
+  uint64_t Percentile(double quantile) const {
+    auto rank = std::max<uint64_t>(std::ceil(quantile * count_), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(UpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t Max() const { return max_; }
+
+ private:
+  static constexpr int kPrecisionBits = 5;
+  static constexpr uint64_t kSubBucketCount = uint64_t{1} << kPrecisionBits;
+
+  static size_t Index(uint64_t latency) {
+    if (latency < kSubBucketCount) {
+      return latency;
+    }
+    int shift = 63 - __builtin_clzll(latency) - kPrecisionBits;
+    return ((shift + 1) << kPrecisionBits) +
+           (latency >> shift) - kSubBucketCount;
+  }
+
+  static uint64_t UpperBound(size_t index) {
+    if (index < kSubBucketCount) {
+      return index;
+    }
+    int shift = (index >> kPrecisionBits) - 1;
+    auto sub_bucket = (index & (kSubBucketCount - 1)) + kSubBucketCount;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+  std::array<uint64_t, (65 - kPrecisionBits) << kPrecisionBits> counts_{};
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+struct OperationLatencies {
+  LatencyHistogram insert;
+  LatencyHistogram lookup;
+  LatencyHistogram remove;
+
+  // As counters in nanoseconds, e.g. insert_p99.9.
+  void Report(benchmark::State& state) const {
+    for (auto [name, histogram] : {std::pair{"insert", &insert},
+                                   std::pair{"lookup", &lookup},
+                                   std::pair{"remove", &remove}}) {
+      std::string prefix = name;
+      state.counters[prefix + "_p50"] = histogram->Percentile(0.5);
+      state.counters[prefix + "_p99"] = histogram->Percentile(0.99);
+      state.counters[prefix + "_p99.9"] = histogram->Percentile(0.999);
+      state.counters[prefix + "_max"] = histogram->Max();
+    }
+  }
+};
+
+template<typename Operation>
+void RecordLatency(LatencyHistogram& histogram, Operation operation) {
+  auto start = std::chrono::steady_clock::now();
+  operation();
+  auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  histogram.Record(latency.count());
+}
+
+}  // namespace
+
+// Grows a table from a single bucket to state.range(0) elements, looking up
+// a random present key after every insert, and then removes every element,
+// so the table shrinks back. Reports the latency percentiles of each
+// operation, whose tails hold the operations that paid for a resize, and the
+// longest resize. An open addressing table moves its elements in one go even
+// in the incremental mode, so there insert_max stays close to max_resize.
+template<typename Backend, ResizeMode kResizeMode>
+void LatencyWhileResizing(benchmark::State& state) {
+  int32_t element_count = state.range(0);
+  HashTableOptions options;
+  options.resize_mode = kResizeMode;
+  std::minstd_rand random;
+  OperationLatencies latencies;
+  uint64_t resize_count = 0;
+  std::chrono::nanoseconds max_resize_time{0};
+  for (auto _ : state) {
+    HashTable<int32_t, int32_t, Backend> hash_table(kHashTableSize, options);
+    for (int32_t i = 0; i < element_count; i++) {
+      RecordLatency(latencies.insert, [&] { hash_table.Insert(i, i); });
+      int32_t key = random() % (i + 1);
+      int32_t value;
+      RecordLatency(latencies.lookup, [&] { hash_table.Lookup(key, value); });
+    }
+    for (int32_t i = 0; i < element_count; i++) {
+      RecordLatency(latencies.remove, [&] { hash_table.Remove(i); });
+    }
+    auto stats = hash_table.Stats();
+    resize_count += stats.resize_count;
+    max_resize_time = std::max(max_resize_time, stats.max_resize_time);
+  }
+  latencies.Report(state);
+  state.counters["resizes"] = resize_count;
+  state.counters["max_resize"] = max_resize_time.count();
+}
+
+// Keeps a table at state.range(0) elements, inserting a new key, looking up
+// a random present one and removing the oldest in turn, so the chained
+// tables never resize. An open addressing table still rehashes at the same
+// size once deleted slots pile up; "resizes" counts both.
+template<typename Backend>
+void LatencyAtFixedSize(benchmark::State& state) {
+  int32_t element_count = state.range(0);
+  HashTable<int32_t, int32_t, Backend> hash_table(kHashTableSize);
+  hash_table.Reserve(element_count);
+  for (int32_t i = 0; i < element_count; i++) {
+    hash_table.Insert(i, i);
+  }
+  auto initial_resize_count = hash_table.Stats().resize_count;
+  std::minstd_rand random;
+  OperationLatencies latencies;
+  int32_t oldest = 0;
+  for (auto _ : state) {
+    for (int32_t i = 0; i < element_count; i++) {
+      int32_t key = oldest + element_count;
+      RecordLatency(latencies.insert, [&] { hash_table.Insert(key, key); });
+      key = oldest + 1 + random() % element_count;
+      int32_t value;
+      RecordLatency(latencies.lookup, [&] { hash_table.Lookup(key, value); });
+      RecordLatency(latencies.remove, [&] { hash_table.Remove(oldest); });
+      ++oldest;
+    }
+  }
+  latencies.Report(state);
+  state.counters["resizes"] =
+      hash_table.Stats().resize_count - initial_resize_count;
+}
 
+BENCHMARK_TEMPLATE(LatencyWhileResizing, ChainingBackend,
+                   ResizeMode::kStopTheWorld)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, ChainingBackend,
+                   ResizeMode::kIncremental)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, ChainingBackend,
+                   ResizeMode::kBackground)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, LockFreeChainingBackend,
+                   ResizeMode::kStopTheWorld)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, LockFreeChainingBackend,
+                   ResizeMode::kIncremental)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, LockFreeChainingBackend,
+                   ResizeMode::kBackground)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, OpenAddressingBackend,
+                   ResizeMode::kStopTheWorld)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, OpenAddressingBackend,
+                   ResizeMode::kIncremental)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyWhileResizing, OpenAddressingBackend,
+                   ResizeMode::kBackground)
+    ->Arg(1 << 22)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(LatencyAtFixedSize, ChainingBackend)
+    ->Arg(1 << 20)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyAtFixedSize, LockFreeChainingBackend)
+    ->Arg(1 << 20)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LatencyAtFixedSize, OpenAddressingBackend)
+    ->Arg(1 << 20)->Iterations(1)->Unit(benchmark::kMillisecond);
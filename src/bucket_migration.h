@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace hash_table_internals {
+
+// Where a bucket of a chained table is in its move to the new table. Readers
+// look in the old chain unless the bucket is moved, and in the new table
+// unless it is unmoved.
+enum class MoveState : uint8_t {
+  kUnmoved,
+  kMoving,
+  kMoved,
+};
+
+// Hands out the buckets of a table that is moved to a new one in ranges,
+// so that any number of threads can move them at once. Ranges are handed out
+// first to last, and the thread that claims a range moves all of it before
+// it returns, so every bucket before one that has started moving is moved or
+// will be without anyone else's help.
+class BucketMigration {
+ public:
+  explicit BucketMigration(size_t bucket_count)
+      : bucket_count_(bucket_count) {}
+
+  // Lets threads claim buckets. Before, every Move is a no-op.
+  void Open() { open_.store(true); }
+
+  bool IsDone() const { return moved_count_.load() == bucket_count_; }
+
+  // Claims ranges and calls move_bucket(i) for each of their buckets, until
+  // `max_bucket_count` buckets are moved or none is left to claim. In the
+  // latter case waits for the ranges other threads are still moving, so a
+  // call with enough budget returns only once the migration is over.
+  // Returns whether it is.
+  template<typename MoveBucket>
+  bool Move(size_t max_bucket_count, MoveBucket move_bucket) {
+    if (!open_.load()) {
+      return false;
+    }
+    size_t moved_count = 0;
+    while (moved_count < max_bucket_count) {
+      auto range_size = std::min(kRangeSize, max_bucket_count - moved_count);
+      // Checked first, so that late helpers do not overflow the counter.
+      auto begin = claimed_count_.load() < bucket_count_
+                   ? claimed_count_.fetch_add(range_size)
+                   : bucket_count_;
+      if (begin >= bucket_count_) {
+        while (!IsDone()) {
+          std::this_thread::yield();
+        }
+        break;
+      }
+      auto end = std::min(begin + range_size, bucket_count_);
+      for (auto i = begin; i < end; i++) {
+        move_bucket(i);
+      }
+      moved_count += end - begin;
+      moved_count_.fetch_add(end - begin);
+    }
+    return IsDone();
+  }
+
+ private:
+  // Large enough to make claims rare, small enough to balance the threads.
+  static constexpr size_t kRangeSize = 256;
+
+  const size_t bucket_count_;
+  std::atomic<bool> open_ = false;
+  std::atomic<size_t> claimed_count_ = 0;
+  std::atomic<size_t> moved_count_ = 0;
+};
+
+}  // namespace hash_table_internals
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace hash_table_internals {
+
+// Looks keys[0], ..., keys[count - 1] up in a chained table and sets found[i]
+// to lookup(i, hash of keys[i]). The keys go in batches: the head links of a
+// whole batch, which head(hash) returns, are requested from memory first,
+// then the first nodes of their chains, and only then is any chain walked,
+// so the cache misses of different keys overlap. Returns the number of keys
+// found.
+template<typename Key, typename Hash, typename Head, typename Lookup>
+size_t MultiLookupInChains(const Key* keys, size_t count, bool* found,
+                           const Hash& hasher, Head head, Lookup lookup) {
+  // Keys looked up together.
+  constexpr size_t kBatchSize = 16;
+
+  std::array<size_t, kBatchSize> hashes;
+  std::array<decltype(head(size_t{})), kBatchSize> heads;
+  size_t found_count = 0;
+  for (size_t begin = 0; begin < count; begin += kBatchSize) {
+    auto batch_size = std::min(kBatchSize, count - begin);
+    for (size_t i = 0; i < batch_size; i++) {
+      hashes[i] = hasher(keys[begin + i]);
+      heads[i] = head(hashes[i]);
+      __builtin_prefetch(heads[i]);
+    }
+    // Prefetching does not dereference, so the nodes need no protection.
+    // Tags in the low bits of a link do not leave the cache line.
+    for (size_t i = 0; i < batch_size; i++) {
+      __builtin_prefetch(heads[i]->load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < batch_size; i++) {
+      auto index = begin + i;
+      found[index] = lookup(index, hashes[i]);
+      found_count += found[index];
+    }
+  }
+  return found_count;
+}
+
+}  // namespace hash_table_internals
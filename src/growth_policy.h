@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// A growth policy picks the bucket counts of a table and maps hashes to
+// buckets. An instance is built for every bucket count, so the mapping may
+// precompute whatever it needs to avoid a division per operation.
+
+// Bucket counts are powers of two. The hash is multiplied by 2^64 / phi and
+// the bucket is taken from the high bits of the product, which depend on all
+// bits of the hash, so identity hashes such as std::hash<int> still spread.
+class PowerOfTwoGrowth {
+ public:
+  static size_t RoundBucketCount(size_t bucket_count) {
+    size_t rounded = 1;
+    while (rounded < bucket_count) {
+      rounded *= 2;
+    }
+    return rounded;
+  }
+
+  static size_t GrownBucketCount(size_t bucket_count) {
+    return bucket_count * 2;
+  }
+
+  static size_t ShrunkBucketCount(size_t bucket_count) {
+    return std::max<size_t>(bucket_count / 2, 1);
+  }
+
+  explicit PowerOfTwoGrowth(size_t bucket_count)
+      : shift_(63 - __builtin_ctzll(bucket_count)) {
+    assert(bucket_count == RoundBucketCount(bucket_count));
+  }
+
+  size_t BucketIndex(size_t hash) const {
+    // Shifted twice, as a single table has a shift of 64.
+    return ((hash * kMultiplier) >> 1) >> shift_;
+  }
+
+ private:
+  static constexpr uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+
+  size_t shift_;
+};
+
+// Bucket counts are primes that roughly double, so the low bits of the hash
+// do not decide the bucket on their own. The modulo is computed from a
+// precomputed reciprocal of the bucket count with two multiplications, see
+// Lemire et al., "Faster Remainder by Direct Computation". Hashes are folded
+// to 32 bits first.
+class PrimeGrowth {
+ public:
+  static size_t RoundBucketCount(size_t bucket_count) {
+    auto it = std::lower_bound(kPrimes.begin(), kPrimes.end(), bucket_count);
+    return it == kPrimes.end() ? kPrimes.back() : *it;
+  }
+
+  static size_t GrownBucketCount(size_t bucket_count) {
+    return RoundBucketCount(bucket_count + 1);
+  }
+
+  static size_t ShrunkBucketCount(size_t bucket_count) {
+    auto it = std::lower_bound(kPrimes.begin(), kPrimes.end(), bucket_count);
+    return it == kPrimes.begin() ? kPrimes.front() : *(it - 1);
+  }
+
+  explicit PrimeGrowth(size_t bucket_count)
+      : bucket_count_(bucket_count),
+        reciprocal_(UINT64_MAX / bucket_count + 1) {
+    assert(bucket_count <= UINT32_MAX);
+  }
+
+  size_t BucketIndex(size_t hash) const {
+    auto folded = static_cast<uint32_t>(hash ^ (hash >> 32));
+    uint64_t fraction = reciprocal_ * folded;
+    return (static_cast<unsigned __int128>(fraction) * bucket_count_) >> 64;
+  }
+
+ private:
+  // Each is the smallest prime above twice the previous one.
+  static constexpr std::array<size_t, 30> kPrimes = {
+      2, 5, 11, 23, 47, 97, 197, 397, 797, 1597, 3203, 6421, 12853, 25717,
+      51437, 102877, 205759, 411527, 823117, 1646237, 3292489, 6584983,
+      13169977, 26339969, 52679969, 105359939, 210719881, 421439783,
+      842879579, 1685759167};
+
+  uint64_t bucket_count_;
+  uint64_t reciprocal_;
+};
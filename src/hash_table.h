@@ -1,362 +1,1371 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "bucket_migration.h"
+#include "chain_lookup.h"
+#include "growth_policy.h"
+#include "lock_free_hash_table.h"
+#include "open_addressing_hash_table.h"
+#include "pool_allocator.h"
 #include "rcu_lock.h"
+#include "reclamation.h"
+#include "sharded_counter.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_local.h"
 
-template<typename Key, typename Value>
-class HashTable;
+enum class ResizeMode {
+  // The writer that triggers a resize moves every bucket to the new table.
+  // Writers of a chained table that run into the resize meanwhile move
+  // buckets along with it.
+  kStopTheWorld,
+  // Every Insert/Remove constructs, moves and destroys a bounded number of
+  // buckets, so the cost of a resize is spread over all writers. Open
+  // addressing only constructs its new groups step by step: any writer may
+  // probe any group, so the elements are moved all at once, with writers
+  // excluded, by the writer that finds the new table complete.
+  kIncremental,
+  // A dedicated thread owned by the table performs every resize, so Insert and
+  // Remove never pay for it.
+  kBackground,
+};
+
+struct HashTableOptions {
+  ResizeMode resize_mode = ResizeMode::kStopTheWorld;
+  // How many buckets a single Insert/Remove constructs or moves to the new
+  // table in the incremental mode. The background resizer checks for shutdown
+  // after each such step.
+  size_t incremental_resize_step = 16;
+  // An Insert that makes the average number of elements per bucket exceed
+  // max_load_factor doubles the table.
+  double max_load_factor = 1;
+  // A Remove that leaves fewer than min_load_factor elements per bucket halves
+  // the table, but never below the initial bucket count. Zero disables
+  // shrinking. Has to stay below a quarter of max_load_factor, so that a table
+  // that has just been resized is not immediately resized back.
+  double min_load_factor = 0.125;
+  // Called with the bucket counts before and after a resize when it starts,
+  // and with its duration too when it finishes, by whichever thread does.
+  // They run under the lock of the resize, so they must not call into the
+  // table.
+  std::function<void(size_t old_bucket_count, size_t new_bucket_count)>
+      on_resize_start;
+  std::function<void(size_t old_bucket_count, size_t new_bucket_count,
+                     std::chrono::nanoseconds duration)>
+      on_resize_finish;
+};
 
 namespace hash_table_internals {
 
-template<typename Key, typename Value>
+// Whether Hash and KeyEqual accept keys of types other than Key, as marked by
+// an is_transparent member type like in std::unordered_map.
+template<typename Hash, typename KeyEqual, typename = void>
+struct IsTransparent : std::false_type {};
+
+template<typename Hash, typename KeyEqual>
+struct IsTransparent<Hash, KeyEqual,
+                     std::void_t<typename Hash::is_transparent,
+                                 typename KeyEqual::is_transparent>>
+    : std::true_type {};
+
+template<typename Key, typename Value, typename Allocator, typename Table>
 class HashTableImpl {
  private:
+  using Hash = typename Table::hasher;
+  using KeyEqual = typename Table::key_equal;
+  using GrowthPolicy = typename Table::growth_policy;
+
   class Bucket {
     friend class HashTableImpl;
 
    public:
     struct Node {
+      template<typename K, typename... Args>
+      Node(size_t hash, K&& key, Args&&... args)
+          : hash(hash), key(std::forward<K>(key)),
+            value(std::forward<Args>(args)...) {}
+
+      // Cached so that moving the node to a new table does not rehash the key,
+      // and chain scans compare keys only when the hashes match.
+      size_t hash = 0;
+      std::array<std::atomic<Node*>, 2> next{nullptr, nullptr};
       Key key;
       Value value;
-      std::array<std::atomic<Node*>, 2> next{nullptr, nullptr};
+
+      template<typename K>
+      bool Matches(const K& other_key, size_t other_hash,
+                   const KeyEqual& key_equal) const {
+        return hash == other_hash && key_equal(key, other_key);
+      }
     };
 
-   public:
-    Bucket() : head_(new Node()) {}
+    using NodeAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
 
+   public:
     ~Bucket() {
-      auto head = head_;
+      auto head = head_.load();
       while (head) {
         auto next = head->next[index_to_cleanup_].load();
-        delete head;
+        DeleteNode(head);
         head = next;
       }
     }
 
-    bool Insert(const Key& key, const Value& value, size_t index) {
-      if (Find(key, index)) {
+    // The node is constructed from `key` and `args` only if the key is new.
+    template<typename K, typename... Args>
+    bool Insert(size_t hash, size_t index, const KeyEqual& key_equal,
+                K&& key, Args&&... args) {
+      if (Find(key, hash, index, key_equal)) {
         return false;
       }
-      Node* new_node{new Node()};
-      new_node->key = key;
-      new_node->value = value;
+      auto* new_node = NodeTraits::allocate(*node_allocator_, 1);
+      NodeTraits::construct(*node_allocator_, new_node, hash,
+                            std::forward<K>(key),
+                            std::forward<Args>(args)...);
       LinkNode(new_node, index);
       return true;
     }
 
     void LinkNode(Node* new_node, size_t index) {
-      new_node->next[index].store(head_->next[index]);
-      head_->next[index].store(new_node);
+      new_node->next[index].store(head_.load());
+      head_.store(new_node);
     }
 
-    bool Remove(const Key& key, size_t index) {
-      auto head = head_;
-      while (head->next[index].load() != nullptr &&
-          head->next[index].load()->key != key) {
-        head = head->next[index].load();
+    // Replaces the node of the key by a copy that holds replace(old value),
+    // unless that returns std::nullopt. Without such a node, inserts a node
+    // with make_value(), unless make_value is nullptr. Returns the replaced
+    // node, which readers may still see until a grace period ends, and
+    // whether a node was inserted.
+    template<typename MakeValue, typename Replace>
+    std::pair<Node*, bool> Upsert(size_t hash, size_t index,
+                                  const KeyEqual& key_equal, const Key& key,
+                                  MakeValue& make_value, Replace& replace) {
+      auto* link = &head_;
+      while (link->load() != nullptr &&
+             !link->load()->Matches(key, hash, key_equal)) {
+        link = &link->load()->next[index];
       }
-      if (head->next[index].load() == nullptr) {
-        return false;
+      auto* node = link->load();
+      if (node == nullptr) {
+        if constexpr (std::is_same_v<MakeValue, std::nullptr_t>) {
+          return {nullptr, false};
+        } else {
+          auto* new_node = NodeTraits::allocate(*node_allocator_, 1);
+          NodeTraits::construct(*node_allocator_, new_node, hash, key,
+                                make_value());
+          LinkNode(new_node, index);
+          return {nullptr, true};
+        }
       }
-      auto next = head->next[index].load();
-      head->next[index].store(head->next[index].load()->next[index].load());
-      bucket_locks_->Synchronize(bucket_number_);
-      delete next;
-      return true;
+      auto value = replace(std::as_const(node->value));
+      if (!value.has_value()) {
+        return {nullptr, false};
+      }
+      auto* new_node = NodeTraits::allocate(*node_allocator_, 1);
+      NodeTraits::construct(*node_allocator_, new_node, hash, node->key,
+                            std::move(*value));
+      // Readers that stand on the old node still find the rest of the chain.
+      new_node->next[index].store(node->next[index].load());
+      link->store(new_node);
+      removal_count_.fetch_add(1);
+      return {node, false};
     }
 
-    bool Lookup(const Key& key, Value& value, int index) {
-      std::optional<Value> result;
-      auto head = head_->next[index].load();
-      while (head != nullptr) {
-        if (head->key == key) {
-          result = head->value;
-          break;
-        }
-        head = head->next[index].load();
+    // Returns the unlinked node, which readers may still see until a grace
+    // period ends.
+    template<typename K>
+    Node* Remove(const K& key, size_t hash, size_t index,
+                 const KeyEqual& key_equal) {
+      auto* link = &head_;
+      while (link->load() != nullptr &&
+             !link->load()->Matches(key, hash, key_equal)) {
+        link = &link->load()->next[index];
       }
-      if (result.has_value()) {
-        value = std::move(*result);
-        return true;
+      auto* node = link->load();
+      if (node != nullptr) {
+        link->store(node->next[index].load());
+        removal_count_.fetch_add(1);
+      }
+      return node;
+    }
+
+    // Returns the detached chain, which readers may still see until a grace
+    // period ends.
+    Node* Clear() {
+      auto* head = head_.exchange(nullptr);
+      removal_count_.fetch_add(1);
+      return head;
+    }
+
+    // Nodes are loaded through `guard`. If it only protects the nodes
+    // themselves, the successor of a removed node may be freed while a reader
+    // still stands on it, so the scan restarts once the bucket loses a node.
+    template<typename K, typename Guard>
+    bool Lookup(const K& key, size_t hash, Value& value, int index,
+                const KeyEqual& key_equal, Guard& guard) {
+      while (true) {
+        auto removal_count = removal_count_.load();
+        auto* node = guard.Protect(0, head_);
+        for (size_t hazard = 1; node != nullptr; hazard ^= 1) {
+          if (Guard::kValidates && removal_count_.load() != removal_count) {
+            break;
+          }
+          if (node->Matches(key, hash, key_equal)) {
+            value = node->value;
+            return true;
+          }
+          node = guard.Protect(hazard, node->next[index]);
+        }
+        if (node == nullptr) {
+          return false;
+        }
       }
-      return false;
     }
 
    private:
-    bool Find(const Key& key, size_t index) {
-      bucket_locks_->lock(bucket_number_);
-      auto head = head_->next[index].load();
-      uint32_t scanned_count = 0;
+    bool Find(const Key& key, size_t hash, size_t index,
+              const KeyEqual& key_equal) {
+      auto head = head_.load();
       bool found = false;
       while (head != nullptr) {
-        ++scanned_count;
-        if (head->key == key) {
+        if (head->Matches(key, hash, key_equal)) {
           found = true;
           break;
         }
         head = head->next[index];
       }
-      if (scanned_count >= kBucketNodeCountBeforeResize) {
-        hash_table_->NeedResize(hash_table_->BucketCount() * 2 + 1);
-      }
-      bucket_locks_->unlock(bucket_number_);
       return found;
     }
 
-   private:
-    static constexpr uint32_t kBucketNodeCountBeforeResize = 3;
+    void DeleteNode(Node* node) {
+      NodeTraits::destroy(*node_allocator_, node);
+      NodeTraits::deallocate(*node_allocator_, node, 1);
+    }
 
-    HashTable<Key, Value>* hash_table_ = nullptr;
-    Node* const head_ = nullptr;
+   private:
+    // The chain of the table the bucket belongs to, linked through
+    // next[index] of that table.
+    std::atomic<Node*> head_ = nullptr;
     size_t index_to_cleanup_ = std::numeric_limits<size_t>::max();
-    RCUPerBucketLock* bucket_locks_ = nullptr;
-    size_t bucket_number_ = 0;
+    NodeAllocator* node_allocator_ = nullptr;
     std::mutex mutex_;
+    // Incremented whenever nodes leave the chain, see Lookup.
+    std::atomic<uint64_t> removal_count_ = 0;
+    // Changed under mutex_.
+    std::atomic<MoveState> move_state_ = MoveState::kUnmoved;
   };
 
  public:
-  explicit HashTableImpl(size_t bucket_count, HashTable<Key, Value>* hash_table,
-                         size_t current_index = 0)
+  explicit HashTableImpl(size_t bucket_count, Table* hash_table,
+                         const Allocator& allocator,
+                         size_t current_index = 0,
+                         bool construct_buckets = true)
       : master_hash_table_(hash_table),
+        node_allocator_(allocator),
         current_index_(current_index),
-        bucket_locks_(bucket_count),
-        buckets_(InitBuckets(bucket_count)) {}
+        bucket_count_(bucket_count),
+        growth_policy_(bucket_count),
+        buckets_(static_cast<Bucket*>(
+                     ::operator new(sizeof(Bucket) * bucket_count))) {
+    if (construct_buckets) {
+      ConstructBuckets(bucket_count);
+    }
+  }
+
+  ~HashTableImpl() {
+    DestroyBuckets(std::numeric_limits<size_t>::max());
+    ::operator delete(buckets_);
+  }
 
   void LinkNode(typename Bucket::Node* node) {
     auto[bucket, bucket_number] =
-    GetBucketInSpecifiedHashTable(this, node->key);
+    GetBucketInSpecifiedHashTable(this, node->hash);
     std::unique_lock<std::mutex> lock(bucket->mutex_);
     return bucket->LinkNode(node, current_index_);
   }
 
-  bool Insert(const Key& key, const Value& value) {
-    UpdateModeOn(key);
-    auto[bucket, index] = GetBucket(this, key);
-    auto result = bucket->Insert(key, value, index);
-    UpdateModeOff(key);
+  template<typename K, typename... Args>
+  bool Insert(K&& key, Args&&... args) {
+    auto hash = hasher_(key);
+    UpdateModeOn(hash);
+    auto[bucket, index] = GetBucket(this, hash);
+    auto result = bucket->Insert(hash, index, key_equal_, std::forward<K>(key),
+                                 std::forward<Args>(args)...);
+    UpdateModeOff(hash);
     return result;
   }
 
-  bool Remove(const Key& key) {
-    UpdateModeOn(key);
-    auto[bucket, index] = GetBucket(this, key);
-    auto result = bucket->Remove(key, index);
-    UpdateModeOff(key);
-    return result;
+  // Inserts without locking the bucket, for a table that no other thread
+  // uses yet. The key is still looked for in its chain, which is short in a
+  // reserved table. Returns whether it was inserted; never runs out of room.
+  template<typename K, typename... Args>
+  std::optional<bool> InsertUnshared(K&& key, Args&&... args) {
+    auto hash = hasher_(key);
+    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, hash);
+    return bucket->Insert(hash, current_index_, key_equal_,
+                          std::forward<K>(key), std::forward<Args>(args)...);
   }
 
-  bool Lookup(const Key& key, Value& value) {
-    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, key);
-    {
-      bucket->bucket_locks_->lock(bucket->bucket_number_);
-      if (bucket_number >= resize_index_.load() &&
-          bucket->Lookup(key, value, current_index_)) {
-        bucket->bucket_locks_->unlock(bucket->bucket_number_);
-        return true;
+  // See Bucket::Upsert. Returns whether a node was inserted.
+  template<typename MakeValue, typename Replace>
+  bool Upsert(const Key& key, MakeValue make_value, Replace replace) {
+    auto hash = hasher_(key);
+    UpdateModeOn(hash);
+    auto[bucket, index] = GetBucket(this, hash);
+    auto[replaced, inserted] =
+        bucket->Upsert(hash, index, key_equal_, key, make_value, replace);
+    UpdateModeOff(hash);
+    if (replaced != nullptr) {
+      master_hash_table_->Retire(replaced);
+    }
+    return inserted;
+  }
+
+  template<typename K>
+  bool Remove(const K& key) {
+    auto hash = hasher_(key);
+    UpdateModeOn(hash);
+    auto[bucket, index] = GetBucket(this, hash);
+    auto* node = bucket->Remove(key, hash, index, key_equal_);
+    UpdateModeOff(hash);
+    if (node == nullptr) {
+      return false;
+    }
+    master_hash_table_->Retire(node);
+    return true;
+  }
+
+  // Runs entirely inside the read-side critical section of the master table:
+  // nodes that leave a chain, whether removed, cleared or left behind in the
+  // old chain of a moved bucket, are retired to it.
+  template<typename K>
+  bool Lookup(const K& key, Value& value) {
+    auto hash = hasher_(key);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    return LookupHashed(key, hash, value, guard);
+  }
+
+  // Like MultiLookupInChains.
+  size_t MultiLookup(const Key* keys, size_t count, Value* values,
+                     bool* found) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    return MultiLookupInChains(
+        keys, count, found, hasher_,
+        [&](size_t hash) {
+          return &GetBucketInSpecifiedHashTable(this, hash).first->head_;
+        },
+        [&](size_t index, size_t hash) {
+          return LookupHashed(keys[index], hash, values[index], guard);
+        });
+  }
+
+  // Buckets start moving to the new table first to last, so they are walked
+  // last to first: once one is found moving, all before it are moved or
+  // about to be, and their nodes are visited in the new table instead.
+  // Requires a guard that keeps every node alive, as the walk cannot
+  // restart.
+  template<typename Function>
+  void ForEach(Function& fn) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    size_t moved_bucket_count = 0;
+    for (size_t i = bucket_count_; i-- > 0;) {
+      auto& bucket = buckets_[i];
+      auto* node = guard.Protect(0, bucket.head_);
+      if (bucket.move_state_.load() != MoveState::kUnmoved) {
+        for (size_t j = 0; j <= i; j++) {
+          while (buckets_[j].move_state_.load() != MoveState::kMoved) {
+            std::this_thread::yield();
+          }
+        }
+        moved_bucket_count = i + 1;
+        break;
+      }
+      // The head was read before the move started, and the move leaves the
+      // chain through this table's links intact.
+      for (; node != nullptr;
+           node = guard.Protect(0, node->next[current_index_])) {
+        fn(node->key, node->value);
       }
-      bucket->bucket_locks_->unlock(bucket->bucket_number_);
     }
+    if (moved_bucket_count == 0) {
+      return;
+    }
+    // The new table is not resized before the read-side critical section
+    // ends, as that waits for a grace period.
+    auto* new_table = new_table_.load();
+    for (size_t i = 0; i < new_table->bucket_count_; i++) {
+      auto* node = guard.Protect(0, new_table->buckets_[i].head_);
+      for (; node != nullptr;
+           node = guard.Protect(0, node->next[new_table->current_index_])) {
+        if (growth_policy_.BucketIndex(node->hash) < moved_bucket_count) {
+          fn(node->key, node->value);
+        }
+      }
+    }
+  }
 
-    auto[new_bucket, new_index] = GetBucket(this, key);
-    if (new_bucket != bucket) {
-      new_bucket->bucket_locks_->lock(new_bucket->bucket_number_);
-      auto result = new_bucket->Lookup(key, value, new_index);
-      new_bucket->bucket_locks_->unlock(new_bucket->bucket_number_);
-      return result;
+  // Visits the elements of the buckets in the `part`-th of `part_count`
+  // equal ranges. Requires that the table is not being resized, so that the
+  // parts together visit every element present throughout exactly once,
+  // even if each is visited in a read-side critical section of its own.
+  template<typename Function>
+  void ForEachPart(size_t part, size_t part_count, Function& fn) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    auto end = bucket_count_ * (part + 1) / part_count;
+    for (size_t i = bucket_count_ * part / part_count; i < end; i++) {
+      for (auto* node = guard.Protect(0, buckets_[i].head_); node != nullptr;
+           node = guard.Protect(0, node->next[current_index_])) {
+        fn(node->key, node->value);
+      }
     }
+  }
 
-    return false;
+  // Counts the buckets that have not started moving by the length of their
+  // chain; the last entry of `histogram` also counts longer chains. Requires
+  // a guard that keeps every node alive.
+  template<typename Histogram>
+  void CountChainLengths(Histogram& histogram) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    for (size_t i = bucket_count_; i-- > 0;) {
+      auto& bucket = buckets_[i];
+      auto* node = guard.Protect(0, bucket.head_);
+      if (bucket.move_state_.load() != MoveState::kUnmoved) {
+        break;
+      }
+      size_t length = 0;
+      for (; node != nullptr;
+           node = guard.Protect(0, node->next[current_index_])) {
+        ++length;
+      }
+      ++histogram[std::min(length, histogram.size() - 1)];
+    }
   }
 
-  void Clear() {
-    auto temp = InitBuckets(buckets_.size());
-    buckets_.swap(temp);
+  size_t Clear() {
+    size_t removed_count = 0;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      auto* bucket = &buckets_[i];
+      std::unique_lock<std::mutex> lock(bucket->mutex_);
+      auto* node = bucket->Clear();
+      while (node != nullptr) {
+        // Read before the node is retired, which may free it right away.
+        auto* next = node->next[current_index_].load();
+        master_hash_table_->Retire(node);
+        node = next;
+        ++removed_count;
+      }
+    }
+    return removed_count;
   }
 
  public:
-  using HashResultType = typename std::hash<Key>::result_type;
-
-  void UpdateModeOn(const Key& key) {
-    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, key);
-    bucket->mutex_.lock();
-    if (bucket_number > resize_index_.load()) {
+  void UpdateModeOn(size_t hash) {
+    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, hash);
+    master_hash_table_->stats_.Lock(bucket->mutex_);
+    if (bucket->move_state_.load() == MoveState::kUnmoved) {
       return;
     }
     auto[new_bucket, new_index] =
-    GetBucketInSpecifiedHashTable(new_table_.load(), key);
-    new_bucket->mutex_.lock();
+    GetBucketInSpecifiedHashTable(new_table_.load(), hash);
+    master_hash_table_->stats_.Lock(new_bucket->mutex_);
     bucket->mutex_.unlock();
   }
 
-  void UpdateModeOff(const Key& key) {
-    auto[bucket, index] = GetBucket(this, key);
+  void UpdateModeOff(size_t hash) {
+    auto[bucket, index] = GetBucket(this, hash);
     bucket->mutex_.unlock();
   }
 
-  size_t BucketCount() const { return buckets_.size(); }
+  size_t BucketCount() const { return bucket_count_; }
+
+  bool NeedsRehash() { return false; }
+
+  // Constructs at most `max_bucket_count` more buckets. Returns true once every
+  // bucket is constructed.
+  bool ConstructBuckets(size_t max_bucket_count) {
+    auto end = constructed_bucket_count_ +
+        std::min(max_bucket_count, bucket_count_ - constructed_bucket_count_);
+    for (; constructed_bucket_count_ < end; constructed_bucket_count_++) {
+      auto* bucket = new (&buckets_[constructed_bucket_count_]) Bucket();
+      bucket->index_to_cleanup_ = current_index_;
+      bucket->node_allocator_ = &node_allocator_;
+    }
+    return constructed_bucket_count_ == bucket_count_;
+  }
 
-  std::vector<Bucket> InitBuckets(size_t bucket_count) {
-    std::vector<Bucket> buckets(bucket_count);
-    for (size_t i = 0; i < bucket_count; i++) {
-      buckets[i].hash_table_ = master_hash_table_;
-      buckets[i].index_to_cleanup_ = current_index_;
-      buckets[i].bucket_locks_ = &bucket_locks_;
-      buckets[i].bucket_number_ = i;
+  // Destroys at most `max_bucket_count` buckets, last to first, so that a
+  // replaced table can be freed in steps. Returns true once every bucket is
+  // destroyed.
+  bool DestroyBuckets(size_t max_bucket_count) {
+    auto end = constructed_bucket_count_ -
+        std::min(max_bucket_count, constructed_bucket_count_);
+    while (constructed_bucket_count_ > end) {
+      buckets_[--constructed_bucket_count_].~Bucket();
     }
-    return buckets;
+    return constructed_bucket_count_ == 0;
   }
 
   static std::pair<Bucket*, int32_t> GetBucketInSpecifiedHashTable(
-      HashTableImpl* hash_table, const Key& key) {
-    auto hash = hash_table->hasher_(key) % hash_table->buckets_.size();
-    return {&hash_table->buckets_[hash], hash};
+      HashTableImpl* hash_table, size_t hash) {
+    auto bucket_number = hash_table->growth_policy_.BucketIndex(hash);
+    return {&hash_table->buckets_[bucket_number], bucket_number};
   }
 
   static std::pair<Bucket*, int32_t> GetBucket(HashTableImpl* hash_table,
-                                               const Key& key) {
+                                               size_t hash) {
     auto[bucket, bucket_number] =
-      GetBucketInSpecifiedHashTable(hash_table, key);
+      GetBucketInSpecifiedHashTable(hash_table, hash);
     auto index = hash_table->current_index_;
-    if (bucket_number <= hash_table->resize_index_.load()) {
+    if (bucket->move_state_.load() != MoveState::kUnmoved) {
       HashTableImpl* new_table = hash_table->new_table_.load();
       auto[new_bucket, new_bucket_number] =
-        GetBucketInSpecifiedHashTable(new_table, key);
+        GetBucketInSpecifiedHashTable(new_table, hash);
       bucket = new_bucket;
       index = new_table->current_index_;
     }
     return {bucket, index};
   }
 
-  HashTableImpl* ReallocateToNewHashTable(size_t new_bucket_count) {
-    auto* new_table = new HashTableImpl(new_bucket_count, master_hash_table_,
-                                        current_index_ ^ 1u);
+  // Buckets of the returned table are constructed later by ConstructBuckets,
+  // so that the allocation does not have to happen in a single operation.
+  HashTableImpl* CreateNewHashTable(size_t new_bucket_count) {
+    return new HashTableImpl(new_bucket_count, master_hash_table_,
+                             Allocator(node_allocator_), current_index_ ^ 1u,
+                             /*construct_buckets =*/ false);
+  }
+
+  bool IsReallocating() const { return new_table_.load() != nullptr; }
+
+  // Buckets are only handed out once every writer sees the new table.
+  void StartReallocation(HashTableImpl* new_table) {
     new_table_.store(new_table);
-    master_hash_table_->lock_.Synchronize();
-    for (size_t i = 0; i < buckets_.size(); i++) {
+    master_hash_table_->Synchronize();
+    migration_.Open();
+  }
+
+  // Moves at most `max_bucket_count` buckets, along with any other threads
+  // that do. Returns true once every bucket lives in the new table. Must be
+  // called inside a read-side critical section or by the resizer.
+  bool ReallocateToNewHashTable(size_t max_bucket_count) {
+    auto* new_table = new_table_.load();
+    return migration_.Move(max_bucket_count, [&](size_t i) {
       auto* bucket = &buckets_[i];
       std::unique_lock<std::mutex> lock(bucket->mutex_);
-      resize_index_.store(i);
-      auto* current_node = bucket->head_->next[current_index_].load();
+      bucket->move_state_.store(MoveState::kMoving);
+      auto* current_node = bucket->head_.load();
       while (current_node) {
         new_table->LinkNode(current_node);
         current_node = current_node->next[current_index_].load();
       }
-      // We have to cut the link to the chain in the old hash table. If a reallocation has progressed beyond the current
-      // bucket, and later an element is removed from the new hash table, readers must not be able to access a removed
-      // element.
-      bucket->head_->next[current_index_] = nullptr;
-      bucket->bucket_locks_->Synchronize(bucket->bucket_number_);
+      // Readers still in the old chain are protected by the master table,
+      // to which nodes later removed from the new chain are retired. Readers
+      // that validate restart and find the bucket empty.
+      bucket->Clear();
+      bucket->move_state_.store(MoveState::kMoved);
+    });
+  }
+
+  void HelpReallocation(size_t max_bucket_count) {
+    ReallocateToNewHashTable(max_bucket_count);
+  }
+
+ private:
+  template<typename K, typename Guard>
+  bool LookupHashed(const K& key, size_t hash, Value& value, Guard& guard) {
+    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, hash);
+    if (bucket->move_state_.load() != MoveState::kMoved &&
+        bucket->Lookup(key, hash, value, current_index_, key_equal_, guard)) {
+      return true;
     }
-    ++resize_index_;
-    return new_table;
+
+    auto[new_bucket, new_index] = GetBucket(this, hash);
+    if (new_bucket != bucket) {
+      return new_bucket->Lookup(key, hash, value, new_index, key_equal_,
+                                guard);
+    }
+
+    return false;
   }
 
  private:
-  HashTable<Key, Value>* const master_hash_table_;
+  Table* const master_hash_table_;
+  // Copies of an allocator free each other's memory, so nodes moved to the
+  // new table are freed by its copy.
+  typename Bucket::NodeAllocator node_allocator_;
   size_t current_index_ = 0;
-  RCUPerBucketLock bucket_locks_;
-  std::vector<Bucket> buckets_;
-  std::hash<Key> hasher_;
+  const size_t bucket_count_;
+  const GrowthPolicy growth_policy_;
+  size_t constructed_bucket_count_ = 0;
+  Bucket* const buckets_;
+  Hash hasher_;
+  KeyEqual key_equal_;
 
  private:
   std::atomic<HashTableImpl*> new_table_ = nullptr;
-  std::atomic<int32_t> resize_index_ = -1;
+  BucketMigration migration_{bucket_count_};
 };
 
 }  // namespace hash_table_internals
 
-template<typename Key, typename Value>
+// Buckets are chains of nodes that are moved to the new table one bucket at a
+// time.
+struct ChainingBackend {
+  template<typename Key, typename Value, typename Allocator, typename Table>
+  using Impl =
+      hash_table_internals::HashTableImpl<Key, Value, Allocator, Table>;
+};
+
+// Like ChainingBackend, but writers link and unlink nodes with CAS instead of
+// locking the bucket, so a hot bucket does not serialize its writers. Only
+// writers of a bucket that is being moved wait for the move to end.
+struct LockFreeChainingBackend {
+  template<typename Key, typename Value, typename Allocator, typename Table>
+  using Impl =
+      hash_table_internals::LockFreeHashTableImpl<Key, Value, Allocator, Table>;
+};
+
+// Elements are placed in a flat array of slots probed 16 at a time, which
+// keeps lookups in few cache lines. A resize moves all elements at once.
+struct OpenAddressingBackend {
+  template<typename Key, typename Value, typename Allocator, typename Table>
+  using Impl = hash_table_internals::OpenAddressingHashTableImpl<
+      Key, Value, Allocator, Table>;
+};
+
+// Elements are allocated one at a time through a rebound copy of Allocator
+// and freed only after the readers that could see them have left, as decided
+// by Reclamation. PoolAllocator makes allocation cheaper, but keeps the peak
+// memory of all its tables for good. Keys are hashed by Hash and compared by
+// KeyEqual, which are default constructed by every table the elements live
+// in. GrowthPolicy picks the bucket counts, rounding the initial one, and
+// maps hashes to buckets. StatsPolicy decides which counters Stats()
+// collects.
+template<typename Key, typename Value, typename Backend = ChainingBackend,
+         typename Allocator = std::allocator<std::pair<const Key, Value>>,
+         typename Reclamation = RCUReclamation,
+         typename Hash = std::hash<Key>,
+         typename KeyEqual = std::equal_to<Key>,
+         typename GrowthPolicy = PowerOfTwoGrowth,
+         typename StatsPolicy = NoStats>
 class HashTable {
-  using HashTableImpl = hash_table_internals::HashTableImpl<Key, Value>;
+  using HashTableImpl =
+      typename Backend::template Impl<Key, Value, Allocator, HashTable>;
+  using ReclamationDomain = typename Reclamation::Domain;
+  using ReclamationGuard = typename ReclamationDomain::Guard;
+  using StatsCounter = hash_table_internals::StatsCounter;
+
+  // Lookup and Remove take keys of any type that Hash and KeyEqual accept,
+  // which have to hash and compare them like the equal Key.
+  template<typename K>
+  using EnableIfTransparent = std::enable_if_t<
+      hash_table_internals::IsTransparent<Hash, KeyEqual>::value &&
+          !std::is_same_v<K, Key>,
+      int>;
 
-  friend class hash_table_internals::HashTableImpl<Key, Value>;
+  friend HashTableImpl;
 
  public:
-  explicit HashTable(size_t bucket_count)
-      : hash_table_impl_(new HashTableImpl(bucket_count, this)) {}
+  using allocator_type = Allocator;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using growth_policy = GrowthPolicy;
+
+  explicit HashTable(size_t bucket_count,
+                     HashTableOptions options = HashTableOptions(),
+                     const Allocator& allocator = Allocator())
+      : HashTable(bucket_count, options, allocator, [](HashTable&) {}) {}
+
+  // Builds the table from the (key, value) pairs in [first, last). Of pairs
+  // with equal keys the first one wins, as with repeated Insert. Given
+  // forward iterators, the table is sized once for all pairs, which are then
+  // linked without the synchronization of Insert, as no other thread can see
+  // the table yet. Each pair still looks for its key, as the range may hold
+  // it twice, but only in a chain or group of the reserved table.
+  template<typename InputIt,
+           typename = typename std::iterator_traits<InputIt>::iterator_category>
+  HashTable(InputIt first, InputIt last, size_t bucket_count = 1,
+            HashTableOptions options = HashTableOptions(),
+            const Allocator& allocator = Allocator())
+      : HashTable(bucket_count, options, allocator, [&](HashTable& table) {
+          using Category =
+              typename std::iterator_traits<InputIt>::iterator_category;
+          if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                          Category>) {
+            table.Reserve(std::distance(first, last));
+            for (; first != last; ++first) {
+              table.InsertUnshared(first->first, first->second);
+            }
+          }
+          for (; first != last; ++first) {
+            table.Insert(first->first, first->second);
+          }
+        }) {}
 
   ~HashTable() {
-    std::unique_lock<RCULock> rcu_lock(lock_);
+    if (resizer_thread_.joinable()) {
+      {
+        std::unique_lock<std::mutex> lock(resizer_mutex_);
+        resizer_stopped_ = true;
+      }
+      resizer_condition_.notify_one();
+      resizer_thread_.join();
+    }
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    // Chains of an unfinished resize are disjoint: moved buckets are cut from
+    // the old table, so each node is deleted exactly once.
+    delete new_hash_table_impl_;
+    delete replaced_hash_table_impl_;
     delete hash_table_impl_.load();
   }
 
   bool Insert(const Key& key, const Value& value) {
-    bool result;
+    return TryEmplace(key, value);
+  }
+
+  bool Insert(Key&& key, Value&& value) {
+    return TryEmplace(std::move(key), std::move(value));
+  }
+
+  // Constructs the value from `args` in place. Neither allocates nor
+  // constructs anything if the key is already present.
+  template<typename... Args>
+  bool TryEmplace(const Key& key, Args&&... args) {
+    return InsertImpl(key, std::forward<Args>(args)...);
+  }
+
+  template<typename... Args>
+  bool TryEmplace(Key&& key, Args&&... args) {
+    return InsertImpl(std::move(key), std::forward<Args>(args)...);
+  }
+
+  // Inserts `value`, or replaces the value of `key` with it. Returns true if
+  // the key was inserted.
+  bool InsertOrAssign(const Key& key, const Value& value) {
+    return UpsertImpl(key, [&] { return Value(value); },
+                      [&](const Value& /*current*/) {
+                        return std::optional<Value>(value);
+                      });
+  }
+
+  // Replaces the value of `key` by a copy that `update(Value&)` has changed.
+  // Returns false if the key is absent.
+  //
+  // Values are replaced rather than changed in place, as readers may still
+  // copy the old one. The update runs under the lock of the bucket, except
+  // with LockFreeChainingBackend, where it runs again if another writer
+  // changes the key before the new value is linked.
+  template<typename Function>
+  bool Update(const Key& key, Function update) {
+    bool found = false;
+    UpsertImpl(key, nullptr, [&](const Value& current) {
+      found = true;
+      std::optional<Value> value(current);
+      update(*value);
+      return value;
+    });
+    return found;
+  }
+
+  // Inserts the value returned by `insert()` if `key` is absent, and applies
+  // `update` like Update otherwise. Returns true if the key was inserted.
+  template<typename InsertFunction, typename UpdateFunction>
+  bool Upsert(const Key& key, InsertFunction insert, UpdateFunction update) {
+    return UpsertImpl(key, [&] { return Value(insert()); },
+                      [&](const Value& current) {
+                        std::optional<Value> value(current);
+                        update(*value);
+                        return value;
+                      });
+  }
+
+  // Returns the value of `key`, inserting the one returned by `factory()`
+  // first if the key is absent.
+  template<typename Factory>
+  Value ComputeIfAbsent(const Key& key, Factory factory) {
+    std::optional<Value> result;
+    UpsertImpl(key,
+               [&] {
+                 result.emplace(factory());
+                 return Value(*result);
+               },
+               [&](const Value& current) {
+                 result.emplace(current);
+                 return std::optional<Value>();
+               });
+    return std::move(*result);
+  }
+
+  bool Remove(const Key& key) { return RemoveImpl(key); }
+
+  template<typename K, EnableIfTransparent<K> = 0>
+  bool Remove(const K& key) {
+    return RemoveImpl(key);
+  }
+
+  bool Lookup(const Key& key, Value& value) { return LookupImpl(key, value); }
+
+  template<typename K, EnableIfTransparent<K> = 0>
+  bool Lookup(const K& key, Value& value) {
+    return LookupImpl(key, value);
+  }
+
+  // Looks up keys[0], ..., keys[count - 1] and sets found[i] to whether
+  // keys[i] is present, in which case its value is stored to values[i]. A
+  // single read-side critical section covers all keys, and the memory
+  // accesses of neighbouring keys are overlapped. Returns the number of keys
+  // found.
+  size_t MultiLookup(const Key* keys, size_t count, Value* values,
+                     bool* found) {
+    stats_.Add(StatsCounter::kLookups, count);
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    return hash_table_impl_.load()->MultiLookup(keys, count, values, found);
+  }
+
+  // Calls fn(key, value) for the elements of the table, without blocking
+  // writers and without copying them. Every element present for the whole
+  // traversal is visited exactly once, also while the table is resized,
+  // with one of the values it had meanwhile; elements inserted or removed
+  // meanwhile may or may not be visited. `fn` runs inside a read-side
+  // critical section, so it must not call into the table.
+  template<typename Function>
+  void ForEach(Function fn) {
+    static_assert(!ReclamationGuard::kValidates,
+                  "hazard pointers do not keep a whole chain alive");
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    hash_table_impl_.load()->ForEach(fn);
+  }
+
+  // Writes the elements to the file at `path` with `serializer`, visiting
+  // them like ForEach, so writers go on meanwhile. The buckets are copied
+  // a range at a time, each in a short read-side critical section, and
+  // written outside of it, so grace periods are not held up by the I/O.
+  // The table is not resized until the copy is over: the load factor may
+  // drift meanwhile, and inserts into a full open addressing table, like
+  // Reserve, wait. The file is replaced only once the snapshot is complete.
+  // Returns whether it was written.
+  template<typename Serializer = TrivialSerializer<Key, Value>>
+  bool SaveSnapshot(const std::string& path,
+                    const Serializer& serializer = Serializer()) {
+    static_assert(!ReclamationGuard::kValidates,
+                  "hazard pointers do not keep a whole chain alive");
+    hash_table_internals::SnapshotWriter writer(path, sizeof(Key),
+                                                sizeof(Value));
+    auto save = [&](const Key& key, const Value& value) {
+      serializer.Save(key, value, writer.Record());
+      writer.EndRecord();
+    };
+    // Without resizes, the current table stays and its buckets keep their
+    // elements between the critical sections.
+    HashTableImpl* hash_table;
     {
-      std::unique_lock<RCULock> rcu_lock(lock_);
-      result = hash_table_impl_.load()->Insert(key, value);
+      std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+      auto bucket_count = resize_bucket_count_.load();
+      if (bucket_count != -1) {
+        ResizeStep(bucket_count, std::numeric_limits<size_t>::max());
+      }
+      ++snapshot_count_;
+      hash_table = hash_table_impl_.load();
     }
-    if (resize_bucket_count_.load() != -1) {
-      Resize(resize_bucket_count_.load());
+    auto part_count =
+        (hash_table->BucketCount() + kSnapshotPartSize - 1) /
+        kSnapshotPartSize;
+    for (size_t part = 0; part < part_count; part++) {
+      {
+        std::unique_lock<ReclamationDomain> read_lock(lock_);
+        hash_table->ForEachPart(part, part_count, save);
+      }
+      writer.FlushIfFull();
     }
-    return result;
+    {
+      std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+      --snapshot_count_;
+    }
+    snapshot_condition_.notify_all();
+    {
+      // Requests made during the save were dropped.
+      std::unique_lock<ReclamationDomain> read_lock(lock_);
+      NeedGrowth();
+      NeedShrink();
+    }
+    return writer.Finish();
+  }
+
+  // Builds a table from a snapshot that SaveSnapshot wrote with an
+  // equivalent serializer. The table is sized once for all elements, which
+  // are then linked without the synchronization of Insert. A snapshot taken
+  // under writers may hold a key twice, in which case the first is kept.
+  // Returns nullptr if the file cannot be read, is corrupted or was written
+  // by a table of another type. A factory rather than a constructor, as the
+  // table cannot be moved.
+  template<typename Serializer = TrivialSerializer<Key, Value>>
+  static std::unique_ptr<HashTable> LoadSnapshot(
+      const std::string& path, const Serializer& serializer = Serializer(),
+      size_t bucket_count = 1, HashTableOptions options = HashTableOptions(),
+      const Allocator& allocator = Allocator()) {
+    hash_table_internals::SnapshotReader reader(path, sizeof(Key),
+                                                sizeof(Value));
+    if (!reader.IsValid()) {
+      return nullptr;
+    }
+    bool complete = false;
+    std::unique_ptr<HashTable> table(new HashTable(
+        bucket_count, options, allocator, [&](HashTable& table) {
+          table.Reserve(reader.RecordCount());
+          auto* data = reader.Records();
+          auto size = reader.RecordsSize();
+          Key key;
+          Value value;
+          for (uint64_t i = 0; i < reader.RecordCount(); i++) {
+            auto record_size = serializer.Load(data, size, key, value);
+            if (record_size == 0) {
+              return;
+            }
+            data += record_size;
+            size -= record_size;
+            table.InsertUnshared(std::move(key), std::move(value));
+          }
+          complete = size == 0;
+        }));
+    if (!complete) {
+      return nullptr;
+    }
+    return table;
+  }
+
+  void Clear() {
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+    if (new_hash_table_impl_ != nullptr) {
+      ResizeStep(new_hash_table_impl_->BucketCount(),
+                 std::numeric_limits<size_t>::max());
+    }
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    int64_t removed_count = hash_table_impl_.load()->Clear();
+    size_.Add(-removed_count, /*batch =*/ 0);
+  }
+
+  // Number of elements. Exact when no writer runs concurrently.
+  size_t Size() { return std::max<int64_t>(size_.Sum(), 0); }
+
+  // Takes a snapshot of HashTableStats, whose counters may be slightly
+  // stale while writers run. Counting the chain lengths walks every bucket.
+  HashTableStats Stats() {
+    HashTableStats stats;
+    stats.lookup_count = stats_.Sum(StatsCounter::kLookups);
+    stats.insert_count = stats_.Sum(StatsCounter::kInserts);
+    stats.update_count = stats_.Sum(StatsCounter::kUpdates);
+    stats.remove_count = stats_.Sum(StatsCounter::kRemoves);
+    stats.size = Size();
+    {
+      std::unique_lock<ReclamationDomain> read_lock(lock_);
+      auto* hash_table = hash_table_impl_.load();
+      stats.bucket_count = hash_table->BucketCount();
+      if constexpr (!ReclamationGuard::kValidates) {
+        hash_table->CountChainLengths(stats.chain_lengths);
+      }
+    }
+    stats.load_factor = static_cast<double>(stats.size) / stats.bucket_count;
+    stats.resize_count = resize_count_.load();
+    stats.resize_time = std::chrono::nanoseconds(resize_time_.load());
+    stats.max_resize_time = std::chrono::nanoseconds(max_resize_time_.load());
+    stats.synchronize_count = stats_.Sum(StatsCounter::kSynchronizes);
+    stats.synchronize_time = std::chrono::nanoseconds(
+        stats_.Sum(StatsCounter::kSynchronizeNanoseconds));
+    // The domain counts its own waits, which are rare enough to always count.
+    if constexpr (StatsPolicy::Recorder::kEnabled) {
+      stats.synchronize_count += lock_.WaitCount();
+      stats.synchronize_time += lock_.WaitTime();
+    }
+    stats.lock_wait_count = stats_.Sum(StatsCounter::kLockWaits);
+    stats.lock_wait_time = std::chrono::nanoseconds(
+        stats_.Sum(StatsCounter::kLockWaitNanoseconds));
+    stats.pending_reclamation_count = lock_.PendingCount();
+    return stats;
   }
 
-  bool Remove(const Key& key) {
+  // Grows the table in a single resize to hold `element_count` elements
+  // without growing again. Does not stop a later shrink.
+  void Reserve(size_t element_count) {
+    auto bucket_count = GrowthPolicy::RoundBucketCount(static_cast<size_t>(
+        std::ceil(element_count / options_.max_load_factor)));
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+    WaitForSnapshots(resize_lock);
+    if (new_hash_table_impl_ != nullptr) {
+      ResizeStep(new_hash_table_impl_->BucketCount(),
+                 std::numeric_limits<size_t>::max());
+    }
+    if (BucketCount() < bucket_count) {
+      ResizeStep(bucket_count, std::numeric_limits<size_t>::max());
+    }
+  }
+
+ private:
+  // Buckets that SaveSnapshot copies in one read-side critical section.
+  static constexpr size_t kSnapshotPartSize = 4096;
+
+  // Runs load(*this) before any other thread, the resizer included, can see
+  // the table.
+  template<typename Load>
+  HashTable(size_t bucket_count, HashTableOptions options,
+            const Allocator& allocator, Load load)
+      : options_(options),
+        min_bucket_count_(GrowthPolicy::RoundBucketCount(bucket_count)),
+        allocator_(allocator),
+        hash_table_impl_(
+            new HashTableImpl(min_bucket_count_, this, allocator)) {
+    assert(options_.min_load_factor * 4 <= options_.max_load_factor);
+    load(*this);
+    StartResizer();
+  }
+
+  size_t BucketCount() const { return hash_table_impl_.load()->BucketCount(); }
+
+  void StartResizer() {
+    if (options_.resize_mode == ResizeMode::kBackground) {
+      resizer_thread_ = std::thread([this] { ResizerRoutine(); });
+    }
+  }
+
+  // Inserts without the synchronization of Insert, while no other thread
+  // can see the table. Like Insert, keeps the element already present.
+  template<typename K, typename V>
+  void InsertUnshared(K&& key, V&& value) {
+    auto result = hash_table_impl_.load()->InsertUnshared(
+        std::forward<K>(key), std::forward<V>(value));
+    if (!result.has_value()) {
+      // Only an open addressing table runs out of room, and it leaves the
+      // arguments untouched.
+      InsertImpl(std::forward<K>(key), std::forward<V>(value));
+    } else if (*result) {
+      size_.Add(1, SizeBatch());
+    }
+  }
+
+  template<typename K, typename... Args>
+  bool InsertImpl(K&& key, Args&&... args) {
+    stats_.Add(StatsCounter::kInserts, 1);
+    return InsertLoop([&](HashTableImpl* hash_table) {
+      return hash_table->Insert(std::forward<K>(key),
+                                std::forward<Args>(args)...);
+    });
+  }
+
+  template<typename MakeValue, typename Replace>
+  bool UpsertImpl(const Key& key, MakeValue make_value, Replace replace) {
+    stats_.Add(StatsCounter::kUpdates, 1);
+    return InsertLoop([&](HashTableImpl* hash_table) {
+      return hash_table->Upsert(key, make_value, replace);
+    });
+  }
+
+  // Runs `insert` on the current table until it returns whether it inserted.
+  // Only an open addressing table may have no room for the key, in which
+  // case `insert` leaves its arguments untouched for the next attempt.
+  template<typename Operation>
+  bool InsertLoop(Operation insert) {
+    std::optional<bool> result;
+    while (true) {
+      HashTableImpl* hash_table;
+      {
+        std::unique_lock<ReclamationDomain> read_lock(lock_);
+        hash_table = hash_table_impl_.load();
+        result = insert(hash_table);
+        if (result.value_or(false) && size_.Add(1, SizeBatch())) {
+          NeedGrowth();
+        }
+      }
+      if (result.has_value()) {
+        break;
+      }
+      FinishResize(hash_table);
+    }
+    HelpResize();
+    return *result;
+  }
+
+  template<typename K>
+  bool RemoveImpl(const K& key) {
+    stats_.Add(StatsCounter::kRemoves, 1);
     bool result;
     {
-      std::unique_lock<RCULock> rcu_lock(lock_);
+      std::unique_lock<ReclamationDomain> read_lock(lock_);
       result = hash_table_impl_.load()->Remove(key);
+      if (result && size_.Add(-1, SizeBatch())) {
+        NeedShrink();
+      }
     }
-    if (resize_bucket_count_.load() != -1) {
-      Resize(resize_bucket_count_.load());
-    }
+    HelpResize();
+    lock_.Throttle();
     return result;
   }
 
-  bool Lookup(const Key& key, Value& value) {
-    std::unique_lock<RCULock> rcu_lock(lock_);
+  template<typename K>
+  bool LookupImpl(const K& key, Value& value) {
+    stats_.Add(StatsCounter::kLookups, 1);
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
     return hash_table_impl_.load()->Lookup(key, value);
   }
 
-  void Clear() {
-    std::unique_lock<RCULock> rcu_lock(lock_);
-    hash_table_impl_.load()->Clear();
+  void HelpResize() {
+    auto bucket_count = resize_bucket_count_.load();
+    if (bucket_count != -1 &&
+        options_.resize_mode != ResizeMode::kBackground) {
+      Resize(bucket_count);
+    }
   }
 
- private:
-  size_t BucketCount() const { return hash_table_impl_.load()->BucketCount(); }
-
   void Resize(size_t bucket_count) {
     if (!resize_mutex_.try_lock()) {
+      HelpReallocation();
       return;
     }
-    auto* old_hash_table = hash_table_impl_.load();
-    if (old_hash_table->BucketCount() == bucket_count) {
-      resize_bucket_count_ = -1;
-      resize_mutex_.unlock();
+    ResizeStep(bucket_count, ResizeStepSize());
+    resize_mutex_.unlock();
+  }
+
+  // Writers that find another thread resizing move buckets along with it,
+  // so that the move is spread over all of them.
+  void HelpReallocation() {
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    hash_table_impl_.load()->HelpReallocation(ResizeStepSize());
+  }
+
+  size_t ResizeStepSize() const {
+    return options_.resize_mode == ResizeMode::kIncremental
+           ? options_.incremental_resize_step
+           : std::numeric_limits<size_t>::max();
+  }
+
+  // Blocks until `full_hash_table` is replaced, growing it unless another
+  // resize is pending.
+  void FinishResize(HashTableImpl* full_hash_table) {
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+    WaitForSnapshots(resize_lock);
+    if (hash_table_impl_.load() != full_hash_table) {
       return;
     }
+    if (new_hash_table_impl_ == nullptr) {
+      DestroyReplacedTable(std::numeric_limits<size_t>::max());
+      NeedResize(GrowthPolicy::GrownBucketCount(BucketCount()));
+    }
+    auto bucket_count = resize_bucket_count_.load();
+    if (bucket_count != -1) {
+      ResizeStep(bucket_count, std::numeric_limits<size_t>::max());
+    }
+  }
 
-    hash_table_impl_.store(
-        old_hash_table->ReallocateToNewHashTable(bucket_count));
-    lock_.Synchronize();
-    resize_bucket_count_ = -1;
-    resize_mutex_.unlock();
-    delete old_hash_table;
+  // Advances the resize by at most `step` constructed, `step` moved and
+  // `step` destroyed buckets. Returns true once the resize is over, and the
+  // replaced table is freed. Requires resize_mutex_.
+  bool ResizeStep(size_t bucket_count, size_t step) {
+    if (!DestroyReplacedTable(step)) {
+      return false;
+    }
+    auto* old_hash_table = hash_table_impl_.load();
+    if (new_hash_table_impl_ == nullptr) {
+      // A request for the same size only rebuilds tables that ask for it.
+      // Requests that slipped past the check of NeedResize as a save began
+      // are dropped, and made again once it ends.
+      if ((old_hash_table->BucketCount() == bucket_count &&
+           !old_hash_table->NeedsRehash()) ||
+          snapshot_count_.load() != 0) {
+        resize_bucket_count_ = -1;
+        return true;
+      }
+      new_hash_table_impl_ = old_hash_table->CreateNewHashTable(bucket_count);
+      resize_start_ = std::chrono::steady_clock::now();
+      if (options_.on_resize_start) {
+        options_.on_resize_start(old_hash_table->BucketCount(),
+                                 new_hash_table_impl_->BucketCount());
+      }
+    }
+    if (!new_hash_table_impl_->ConstructBuckets(step)) {
+      return false;
+    }
+    if (!old_hash_table->IsReallocating()) {
+      old_hash_table->StartReallocation(new_hash_table_impl_);
+    }
+    if (!old_hash_table->ReallocateToNewHashTable(step)) {
+      return false;
+    }
+
+    hash_table_impl_.store(new_hash_table_impl_);
+    new_hash_table_impl_ = nullptr;
+    Synchronize();
+    replaced_hash_table_impl_ = old_hash_table;
+    auto old_bucket_count = old_hash_table->BucketCount();
     ++resize_count_;
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - resize_start_);
+    resize_time_ += duration.count();
+    if (duration.count() > max_resize_time_.load()) {
+      max_resize_time_ = duration.count();
+    }
+    if (options_.on_resize_finish) {
+      options_.on_resize_finish(old_bucket_count, BucketCount(), duration);
+    }
+    return DestroyReplacedTable(step);
+  }
+
+  // Destroying every bucket of a large table at once would stall a single
+  // writer, so the replaced table is destroyed `step` buckets at a time. The
+  // resize stays pending until the table is freed, so that writers go on
+  // destroying it. Returns true once it is freed. Requires resize_mutex_.
+  bool DestroyReplacedTable(size_t step) {
+    if (replaced_hash_table_impl_ == nullptr) {
+      return true;
+    }
+    if (!replaced_hash_table_impl_->DestroyBuckets(step)) {
+      return false;
+    }
+    delete replaced_hash_table_impl_;
+    replaced_hash_table_impl_ = nullptr;
+    resize_bucket_count_ = -1;
+    return true;
+  }
+
+  // Blocks while SaveSnapshot copies the current table. Requires
+  // resize_mutex_, which is released while waiting.
+  void WaitForSnapshots(std::unique_lock<std::mutex>& resize_lock) {
+    snapshot_condition_.wait(resize_lock,
+                             [this] { return snapshot_count_.load() == 0; });
+  }
+
+  // Must not be called inside a read-side critical section.
+  void Synchronize() {
+    stats_.Time(StatsCounter::kSynchronizes,
+                StatsCounter::kSynchronizeNanoseconds,
+                [this] { lock_.Synchronize(); });
+  }
+
+  // Frees `object` through allocator_ once no reader can reach it.
+  template<typename T>
+  void Retire(T* object) {
+    lock_.Retire({object, &HashTable::Reclaim<T>, this});
+  }
+
+  template<typename T>
+  static void Reclaim(void* hash_table, void* object) {
+    using ObjectAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using ObjectTraits = std::allocator_traits<ObjectAllocator>;
+    ObjectAllocator allocator(static_cast<HashTable*>(hash_table)->allocator_);
+    ObjectTraits::destroy(allocator, static_cast<T*>(object));
+    ObjectTraits::deallocate(allocator, static_cast<T*>(object), 1);
+  }
+
+  // Each writer flushes its part of the element count at most every 64
+  // updates; small tables flush more often, so that they grow in time.
+  int64_t SizeBatch() const {
+    return std::clamp<int64_t>(BucketCount() / 16, 1, 64);
+  }
+
+  // NeedGrowth and NeedShrink must be called inside a read-side critical
+  // section, as they look at the current table.
+  void NeedGrowth() {
+    auto bucket_count = BucketCount();
+    if (size_.Total() > bucket_count * options_.max_load_factor) {
+      NeedResize(GrowthPolicy::GrownBucketCount(bucket_count));
+    }
+  }
+
+  void NeedShrink() {
+    auto bucket_count = BucketCount();
+    if (bucket_count > min_bucket_count_ &&
+        size_.Total() < bucket_count * options_.min_load_factor) {
+      NeedResize(std::max(min_bucket_count_,
+                          GrowthPolicy::ShrunkBucketCount(bucket_count)));
+    }
   }
 
   void NeedResize(size_t bucket_count) {
-    if (resize_bucket_count_.load() != -1) {
+    if (resize_bucket_count_.load() != -1 || snapshot_count_.load() != 0) {
       return;
     }
     int32_t expected = -1;
-    resize_bucket_count_.compare_exchange_strong(expected, bucket_count);
+    if (resize_bucket_count_.compare_exchange_strong(expected, bucket_count) &&
+        options_.resize_mode == ResizeMode::kBackground) {
+      // Taking the mutex orders the store before the resizer checks for work,
+      // so the notification cannot be lost.
+      { std::unique_lock<std::mutex> lock(resizer_mutex_); }
+      resizer_condition_.notify_one();
+    }
+  }
+
+  void ResizerRoutine() {
+    std::unique_lock<std::mutex> lock(resizer_mutex_);
+    while (true) {
+      resizer_condition_.wait(lock, [this] {
+        return resizer_stopped_ || resize_bucket_count_.load() != -1;
+      });
+      if (resizer_stopped_) {
+        return;
+      }
+      lock.unlock();
+      {
+        std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+        // Clear() may have finished the resize in the meantime.
+        auto bucket_count = resize_bucket_count_.load();
+        while (bucket_count != -1 &&
+               !ResizeStep(bucket_count, options_.incremental_resize_step) &&
+               !resizer_stopped_.load()) {
+        }
+      }
+      lock.lock();
+    }
   }
 
  private:
+  const HashTableOptions options_;
+  const size_t min_bucket_count_;
+  const Allocator allocator_;
   std::atomic<HashTableImpl*> hash_table_impl_;
-  RCULock lock_;
+  // Declared after allocator_, which frees the elements still retired when
+  // the domain is destroyed.
+  ReclamationDomain lock_;
   std::mutex resize_mutex_;
+  // The table a resize moves the elements to; guarded by resize_mutex_.
+  HashTableImpl* new_hash_table_impl_ = nullptr;
+  // The table a finished resize replaced, which is not destroyed yet;
+  // guarded by resize_mutex_.
+  HashTableImpl* replaced_hash_table_impl_ = nullptr;
+  // When the resize of new_hash_table_impl_ started; guarded by resize_mutex_.
+  std::chrono::steady_clock::time_point resize_start_;
   std::atomic<std::uint32_t> resize_count_ = 0;
+  // In nanoseconds; written under resize_mutex_.
+  std::atomic<int64_t> resize_time_ = 0;
+  std::atomic<int64_t> max_resize_time_ = 0;
   std::atomic<int32_t> resize_bucket_count_ = -1;
+  // Saves that copy the current table, which must not be replaced meanwhile;
+  // changed under resize_mutex_.
+  std::atomic<int32_t> snapshot_count_ = 0;
+  std::condition_variable snapshot_condition_;
+  // Removing a just inserted key may decrement before the insert increments,
+  // so the count may briefly be negative.
+  hash_table_internals::ShardedCounter size_;
+  typename StatsPolicy::Recorder stats_;
+
+  // Only used in the background resize mode.
+  std::thread resizer_thread_;
+  std::mutex resizer_mutex_;
+  std::condition_variable resizer_condition_;
+  std::atomic<bool> resizer_stopped_ = false;
 };
\ No newline at end of file
@@ -0,0 +1,706 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bucket_migration.h"
+#include "chain_lookup.h"
+
+namespace hash_table_internals {
+
+// Chained table whose writers never lock. A chain is a Harris-Michael list:
+// a node is removed by first tagging its own next link as deleted, which
+// linearizes the removal, and then unlinking it with a CAS on the link that
+// points to it. Any traversal that meets a deleted node helps to unlink it,
+// and whoever unlinks a node retires it to the master table. Inserts only
+// prepend, with a CAS on the head the search started from, so a key is never
+// linked twice.
+//
+// Nodes have a next link per table, like in HashTableImpl. Moving a bucket to
+// the new table first freezes its chain: the head and every next link get a
+// frozen tag, after which no CAS on them succeeds. The nodes that are not
+// deleted are then linked to the new table, and the deleted ones, which can
+// no longer be unlinked, are retired by the mover. A writer that runs into a
+// frozen chain waits until the bucket is moved and retries in the new table,
+// so only writers of the bucket being moved ever wait.
+template<typename Key, typename Value, typename Allocator, typename Table>
+class LockFreeHashTableImpl {
+ private:
+  using Hash = typename Table::hasher;
+  using KeyEqual = typename Table::key_equal;
+  using GrowthPolicy = typename Table::growth_policy;
+
+  // Hazard pointer that TryFind keeps on the head of the chain, next to the
+  // three it rotates through.
+  static constexpr size_t kHeadHazard = 3;
+
+  struct Node {
+    template<typename K, typename... Args>
+    Node(size_t hash, K&& key, Args&&... args)
+        : hash(hash), key(std::forward<K>(key)),
+          value(std::forward<Args>(args)...) {}
+
+    size_t hash = 0;
+    // Tagged pointers, see kDeleted and kFrozen.
+    std::array<std::atomic<Node*>, 2> next{nullptr, nullptr};
+    Key key;
+    Value value;
+
+    template<typename K>
+    bool Matches(const K& other_key, size_t other_hash,
+                 const KeyEqual& key_equal) const {
+      return hash == other_hash && key_equal(key, other_key);
+    }
+  };
+
+  using NodeAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+  // Set on the next link of a node that is logically removed.
+  static constexpr uintptr_t kDeleted = 1;
+  // Set on every link of a chain that is being moved to the new table.
+  static constexpr uintptr_t kFrozen = 2;
+  static constexpr uintptr_t kTags = kDeleted | kFrozen;
+
+  static_assert(alignof(Node) > kTags, "tags need the low bits of nodes");
+
+  struct Bucket {
+    std::atomic<Node*> head = nullptr;
+    // Incremented whenever nodes leave the chain, see LookupInBucket.
+    std::atomic<uint64_t> removal_count = 0;
+    // Moving from the time the chain is frozen until all of it is moved.
+    std::atomic<MoveState> move_state = MoveState::kUnmoved;
+  };
+
+  enum class Status {
+    kFound,
+    kAbsent,
+    // The chain is frozen; the operation has to go to the new table.
+    kFrozen,
+    // The chain changed under the search, which has to start over.
+    kRetry,
+  };
+
+  // Where a search ended: `link` points to `node`, the first node that holds
+  // the key, or is the null link at the end of the chain.
+  struct Window {
+    Node* head = nullptr;
+    std::atomic<Node*>* link = nullptr;
+    Node* node = nullptr;
+    Node* next = nullptr;
+  };
+
+ public:
+  explicit LockFreeHashTableImpl(size_t bucket_count, Table* hash_table,
+                                 const Allocator& allocator,
+                                 size_t current_index = 0,
+                                 bool construct_buckets = true)
+      : master_hash_table_(hash_table),
+        node_allocator_(allocator),
+        current_index_(current_index),
+        bucket_count_(bucket_count),
+        growth_policy_(bucket_count),
+        buckets_(static_cast<Bucket*>(
+                     ::operator new(sizeof(Bucket) * bucket_count))) {
+    if (construct_buckets) {
+      ConstructBuckets(bucket_count);
+    }
+  }
+
+  ~LockFreeHashTableImpl() {
+    DestroyBuckets(std::numeric_limits<size_t>::max());
+    ::operator delete(buckets_);
+  }
+
+  template<typename K, typename... Args>
+  bool Insert(K&& key, Args&&... args) {
+    auto hash = hasher_(key);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    Node* node = nullptr;
+    auto make_node = [&] {
+      auto* new_node = NodeTraits::allocate(node_allocator_, 1);
+      NodeTraits::construct(node_allocator_, new_node, hash,
+                            std::forward<K>(key), std::forward<Args>(args)...);
+      return new_node;
+    };
+    auto status = Apply(hash, [&](LockFreeHashTableImpl& table,
+                                  Bucket& bucket) {
+      return table.InsertIntoBucket(bucket, key, hash, node, make_node, guard);
+    });
+    if (status == Status::kFound && node != nullptr) {
+      // Allocated by an attempt that lost to an insert of the same key, and
+      // never published.
+      DeleteNode(node);
+    }
+    return status == Status::kAbsent;
+  }
+
+  // Like HashTableImpl::InsertUnshared.
+  template<typename K, typename... Args>
+  std::optional<bool> InsertUnshared(K&& key, Args&&... args) {
+    auto hash = hasher_(key);
+    for (auto* node = Untag(GetBucket(hash).head.load()); node != nullptr;
+         node = Untag(node->next[current_index_].load())) {
+      if (node->Matches(key, hash, key_equal_)) {
+        return false;
+      }
+    }
+    auto* node = NodeTraits::allocate(node_allocator_, 1);
+    NodeTraits::construct(node_allocator_, node, hash, std::forward<K>(key),
+                          std::forward<Args>(args)...);
+    LinkNode(node);
+    return true;
+  }
+
+  // Like HashTableImpl::Bucket::Upsert, but there is no lock to keep other
+  // writers away: `replace` runs again if the node changes before its
+  // replacement is linked, and `make_value` may run for an insert that loses
+  // to another. Returns whether a node was inserted.
+  template<typename MakeValue, typename Replace>
+  bool Upsert(const Key& key, MakeValue make_value, Replace replace) {
+    auto hash = hasher_(key);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    Node* node = nullptr;
+    auto status = Apply(hash, [&](LockFreeHashTableImpl& table,
+                                  Bucket& bucket) {
+      return table.UpsertIntoBucket(bucket, key, hash, node, make_value,
+                                    replace, guard);
+    });
+    if (status == Status::kFound && node != nullptr) {
+      DeleteNode(node);
+    }
+    return status == Status::kAbsent && node != nullptr;
+  }
+
+  template<typename K>
+  bool Remove(const K& key) {
+    auto hash = hasher_(key);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    auto status = Apply(hash, [&](LockFreeHashTableImpl& table,
+                                  Bucket& bucket) {
+      return table.RemoveFromBucket(bucket, key, hash, guard);
+    });
+    return status == Status::kFound;
+  }
+
+  // A bucket that is being moved is complete in the old table until its
+  // chain is cut, and by then all of its nodes are in the new table.
+  template<typename K>
+  bool Lookup(const K& key, Value& value) {
+    auto hash = hasher_(key);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    return LookupHashed(key, hash, value, guard);
+  }
+
+  // Like HashTableImpl::MultiLookup.
+  size_t MultiLookup(const Key* keys, size_t count, Value* values,
+                     bool* found) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    return MultiLookupInChains(
+        keys, count, found, hasher_,
+        [&](size_t hash) { return &GetBucket(hash).head; },
+        [&](size_t index, size_t hash) {
+          return LookupHashed(keys[index], hash, values[index], guard);
+        });
+  }
+
+  // Like HashTableImpl::ForEach. A chain whose head is not frozen yet is
+  // complete through this table's links, which the move only tags.
+  template<typename Function>
+  void ForEach(Function& fn) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    size_t moved_bucket_count = 0;
+    for (size_t i = bucket_count_; i-- > 0;) {
+      auto* node = guard.Protect(0, buckets_[i].head);
+      if (HasTag(node, kFrozen)) {
+        for (size_t j = 0; j <= i; j++) {
+          while (buckets_[j].move_state.load() != MoveState::kMoved) {
+            std::this_thread::yield();
+          }
+        }
+        moved_bucket_count = i + 1;
+        break;
+      }
+      VisitChain(node, current_index_, fn, guard, [](Node*) { return true; });
+    }
+    if (moved_bucket_count == 0) {
+      return;
+    }
+    auto* new_table = new_table_.load();
+    for (size_t i = 0; i < new_table->bucket_count_; i++) {
+      VisitChain(guard.Protect(0, new_table->buckets_[i].head),
+                 new_table->current_index_, fn, guard, [&](Node* node) {
+                   return growth_policy_.BucketIndex(node->hash) <
+                          moved_bucket_count;
+                 });
+    }
+  }
+
+  // Like HashTableImpl::ForEachPart.
+  template<typename Function>
+  void ForEachPart(size_t part, size_t part_count, Function& fn) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    auto end = bucket_count_ * (part + 1) / part_count;
+    for (size_t i = bucket_count_ * part / part_count; i < end; i++) {
+      VisitChain(guard.Protect(0, buckets_[i].head), current_index_, fn,
+                 guard, [](Node*) { return true; });
+    }
+  }
+
+  // Like HashTableImpl::CountChainLengths; deleted nodes do not count.
+  template<typename Histogram>
+  void CountChainLengths(Histogram& histogram) {
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    for (size_t i = bucket_count_; i-- > 0;) {
+      auto* node = guard.Protect(0, buckets_[i].head);
+      if (HasTag(node, kFrozen)) {
+        break;
+      }
+      size_t length = 0;
+      auto count = [&](const Key&, const Value&) { ++length; };
+      VisitChain(node, current_index_, count, guard,
+                 [](Node*) { return true; });
+      ++histogram[std::min(length, histogram.size() - 1)];
+    }
+  }
+
+  // The chains are cut from the buckets and then frozen, so writers that are
+  // still in them give up and retry from the now empty head.
+  size_t Clear() {
+    size_t removed_count = 0;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      auto& bucket = buckets_[i];
+      auto* node = bucket.head.exchange(nullptr);
+      if (node == nullptr) {
+        continue;
+      }
+      // Readers that start from now on cannot reach the cut chain.
+      bucket.removal_count.fetch_add(1);
+      FreezeChain(node, [&](Node* frozen_node, bool deleted) {
+        if (!deleted) {
+          ++removed_count;
+        }
+        master_hash_table_->Retire(frozen_node);
+      });
+    }
+    return removed_count;
+  }
+
+  size_t BucketCount() const { return bucket_count_; }
+
+  bool NeedsRehash() { return false; }
+
+  // Like HashTableImpl::ConstructBuckets.
+  bool ConstructBuckets(size_t max_bucket_count) {
+    auto end = constructed_bucket_count_ +
+        std::min(max_bucket_count, bucket_count_ - constructed_bucket_count_);
+    for (; constructed_bucket_count_ < end; constructed_bucket_count_++) {
+      new (&buckets_[constructed_bucket_count_]) Bucket();
+    }
+    return constructed_bucket_count_ == bucket_count_;
+  }
+
+  // Like HashTableImpl::DestroyBuckets. Deleted nodes that are still linked
+  // were never retired, so they are freed here too. Moved buckets are left
+  // with an empty chain.
+  bool DestroyBuckets(size_t max_bucket_count) {
+    auto end = constructed_bucket_count_ -
+        std::min(max_bucket_count, constructed_bucket_count_);
+    while (constructed_bucket_count_ > end) {
+      auto& bucket = buckets_[--constructed_bucket_count_];
+      auto* node = Untag(bucket.head.load());
+      while (node != nullptr) {
+        auto* next = Untag(node->next[current_index_].load());
+        DeleteNode(node);
+        node = next;
+      }
+      bucket.~Bucket();
+    }
+    return constructed_bucket_count_ == 0;
+  }
+
+  // Like HashTableImpl::CreateNewHashTable.
+  LockFreeHashTableImpl* CreateNewHashTable(size_t new_bucket_count) {
+    return new LockFreeHashTableImpl(new_bucket_count, master_hash_table_,
+                                     Allocator(node_allocator_),
+                                     current_index_ ^ 1u,
+                                     /*construct_buckets =*/ false);
+  }
+
+  bool IsReallocating() const { return new_table_.load() != nullptr; }
+
+  void StartReallocation(LockFreeHashTableImpl* new_table) {
+    new_table_.store(new_table);
+    master_hash_table_->Synchronize();
+    migration_.Open();
+  }
+
+  // Like HashTableImpl::ReallocateToNewHashTable.
+  bool ReallocateToNewHashTable(size_t max_bucket_count) {
+    auto* new_table = new_table_.load();
+    std::vector<Node*> deleted_nodes;
+    return migration_.Move(max_bucket_count, [&](size_t i) {
+      auto& bucket = buckets_[i];
+      // Readers look in both tables from now on.
+      bucket.move_state.store(MoveState::kMoving);
+      auto* head = bucket.head.load();
+      while (!bucket.head.compare_exchange_weak(head, Tag(head, kFrozen))) {
+      }
+      FreezeChain(head, [&](Node* node, bool deleted) {
+        if (deleted) {
+          deleted_nodes.push_back(node);
+        } else {
+          new_table->LinkNode(node);
+        }
+      });
+      bucket.head.store(Tag(nullptr, kFrozen));
+      // Readers still in the old chain are protected by the master table,
+      // to which nodes later removed from the new chain are retired. Readers
+      // that validate restart and find the bucket empty.
+      bucket.removal_count.fetch_add(1);
+      for (auto* node : deleted_nodes) {
+        master_hash_table_->Retire(node);
+      }
+      deleted_nodes.clear();
+      // Writers of the bucket may go to the new table.
+      bucket.move_state.store(MoveState::kMoved);
+    });
+  }
+
+  void HelpReallocation(size_t max_bucket_count) {
+    ReallocateToNewHashTable(max_bucket_count);
+  }
+
+ private:
+  Bucket& GetBucket(size_t hash) {
+    return buckets_[growth_policy_.BucketIndex(hash)];
+  }
+
+  static Node* Untag(Node* node) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(node) & ~kTags);
+  }
+
+  static Node* Tag(Node* node, uintptr_t tag) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(node) | tag);
+  }
+
+  static bool HasTag(Node* node, uintptr_t tag) {
+    return (reinterpret_cast<uintptr_t>(node) & tag) != 0;
+  }
+
+  // Runs `operation` on the bucket of `hash`, in the new table if the bucket
+  // has been moved.
+  template<typename Operation>
+  Status Apply(size_t hash, Operation operation) {
+    auto& bucket = GetBucket(hash);
+    if (bucket.move_state.load() != MoveState::kMoved) {
+      auto status = operation(*this, bucket);
+      if (status != Status::kFrozen) {
+        return status;
+      }
+      // Retrying before the move is over could insert a key twice.
+      while (bucket.move_state.load() != MoveState::kMoved) {
+        std::this_thread::yield();
+      }
+    }
+    auto* new_table = new_table_.load();
+    return operation(*new_table, new_table->GetBucket(hash));
+  }
+
+  // Returns kAbsent if the node was inserted. `node` is made by `make_node`
+  // once the key is found to be absent, and reused by the following
+  // attempts, which search for its key as `key` may have been moved from.
+  template<typename MakeNode, typename Guard>
+  Status InsertIntoBucket(Bucket& bucket, const Key& key, size_t hash,
+                          Node*& node, MakeNode& make_node, Guard& guard) {
+    while (true) {
+      Window window;
+      auto status = Find(bucket, node == nullptr ? key : node->key, hash,
+                         guard, window);
+      if (status != Status::kAbsent) {
+        return status;
+      }
+      if (node == nullptr) {
+        node = make_node();
+      }
+      node->next[current_index_].store(window.head);
+      // Inserts only prepend, so an unchanged head means that no insert ran
+      // since the search began. TryFind keeps the head protected, so it
+      // cannot have been freed and reused as the head of another insert.
+      auto* expected = window.head;
+      if (bucket.head.compare_exchange_strong(expected, node)) {
+        return Status::kAbsent;
+      }
+    }
+  }
+
+  // A node is replaced by tagging its next link as deleted and pointing it to
+  // the replacement, which links to the old successor: the old value is gone
+  // and the new one is reachable in the same CAS. Returns kAbsent if the key
+  // was absent, in which case `node` is set if it has been inserted.
+  template<typename MakeValue, typename Replace, typename Guard>
+  Status UpsertIntoBucket(Bucket& bucket, const Key& key, size_t hash,
+                          Node*& node, MakeValue& make_value,
+                          Replace& replace, Guard& guard) {
+    while (true) {
+      Window window;
+      auto status = Find(bucket, key, hash, guard, window);
+      if (status == Status::kFrozen) {
+        return status;
+      }
+      if (status == Status::kAbsent) {
+        if constexpr (std::is_same_v<MakeValue, std::nullptr_t>) {
+          return status;
+        } else {
+          auto make_node = [&] {
+            auto* new_node = NodeTraits::allocate(node_allocator_, 1);
+            NodeTraits::construct(node_allocator_, new_node, hash, key,
+                                  make_value());
+            return new_node;
+          };
+          status = InsertIntoBucket(bucket, key, hash, node, make_node, guard);
+          if (status != Status::kFound) {
+            return status;
+          }
+          // Lost to an insert of the key, whose value is replaced instead.
+          continue;
+        }
+      }
+      auto value = replace(std::as_const(window.node->value));
+      if (!value.has_value()) {
+        return status;
+      }
+      auto* replacement = NodeTraits::allocate(node_allocator_, 1);
+      NodeTraits::construct(node_allocator_, replacement, hash,
+                            window.node->key, std::move(*value));
+      replacement->next[current_index_].store(window.next);
+      auto* next = window.next;
+      if (!window.node->next[current_index_].compare_exchange_strong(
+              next, Tag(replacement, kDeleted))) {
+        DeleteNode(replacement);
+        continue;
+      }
+      auto* expected = window.node;
+      if (window.link->compare_exchange_strong(expected, replacement)) {
+        bucket.removal_count.fetch_add(1);
+        master_hash_table_->Retire(window.node);
+      } else {
+        Find(bucket, key, hash, guard, window);
+      }
+      return status;
+    }
+  }
+
+  template<typename K, typename Guard>
+  Status RemoveFromBucket(Bucket& bucket, const K& key, size_t hash,
+                          Guard& guard) {
+    while (true) {
+      Window window;
+      auto status = Find(bucket, key, hash, guard, window);
+      if (status != Status::kFound) {
+        return status;
+      }
+      auto* next = window.next;
+      if (!window.node->next[current_index_].compare_exchange_strong(
+              next, Tag(next, kDeleted))) {
+        // Removed by somebody else, frozen, or its successor changed.
+        continue;
+      }
+      auto* expected = window.node;
+      if (window.link->compare_exchange_strong(expected, next)) {
+        bucket.removal_count.fetch_add(1);
+        master_hash_table_->Retire(window.node);
+      } else {
+        // Another search unlinks it, unless the chain has been frozen, in
+        // which case it is retired by whoever froze it.
+        Find(bucket, key, hash, guard, window);
+      }
+      return Status::kFound;
+    }
+  }
+
+  template<typename K, typename Guard>
+  Status Find(Bucket& bucket, const K& key, size_t hash, Guard& guard,
+              Window& window) {
+    while (true) {
+      auto status = TryFind(bucket, key, hash, guard, window);
+      if (status != Status::kRetry) {
+        return status;
+      }
+      // A frozen link behind an unfrozen head belongs to a chain that Clear
+      // has cut, so the search starts over from the head.
+      if (HasTag(bucket.head.load(), kFrozen)) {
+        return Status::kFrozen;
+      }
+    }
+  }
+
+  // Keeps the predecessor, the current and the next node in three rotating
+  // hazard pointers, and the head in kHeadHazard for as long as the window
+  // is used. A node whose predecessor still links to it untagged is in the
+  // chain, and so was its successor when it was read.
+  template<typename K, typename Guard>
+  Status TryFind(Bucket& bucket, const K& key, size_t hash, Guard& guard,
+                 Window& window) {
+    std::atomic<Node*>* link = &bucket.head;
+    size_t pred_hazard = kHeadHazard;
+    size_t cur_hazard = kHeadHazard;
+    auto* cur = guard.Protect(kHeadHazard, *link);
+    if (HasTag(cur, kFrozen)) {
+      return Status::kFrozen;
+    }
+    window.head = cur;
+    while (cur != nullptr) {
+      // The first of the rotating hazard pointers that is free.
+      size_t next_hazard = 0;
+      while (next_hazard == pred_hazard || next_hazard == cur_hazard) {
+        ++next_hazard;
+      }
+      auto* next = guard.Protect(next_hazard, cur->next[current_index_]);
+      if (link->load() != cur || HasTag(next, kFrozen)) {
+        return Status::kRetry;
+      }
+      if (HasTag(next, kDeleted)) {
+        auto* expected = cur;
+        if (!link->compare_exchange_strong(expected, Untag(next))) {
+          return Status::kRetry;
+        }
+        bucket.removal_count.fetch_add(1);
+        master_hash_table_->Retire(cur);
+        cur = Untag(next);
+        cur_hazard = next_hazard;
+        continue;
+      }
+      if (cur->Matches(key, hash, key_equal_)) {
+        window.link = link;
+        window.node = cur;
+        window.next = next;
+        return Status::kFound;
+      }
+      link = &cur->next[current_index_];
+      pred_hazard = cur_hazard;
+      cur_hazard = next_hazard;
+      cur = next;
+    }
+    window.link = link;
+    window.node = nullptr;
+    return Status::kAbsent;
+  }
+
+  template<typename K, typename Guard>
+  bool LookupHashed(const K& key, size_t hash, Value& value, Guard& guard) {
+    auto& bucket = GetBucket(hash);
+    if (bucket.move_state.load() != MoveState::kMoved &&
+        LookupInBucket(bucket, key, hash, value, guard)) {
+      return true;
+    }
+    if (bucket.move_state.load() != MoveState::kUnmoved) {
+      auto* new_table = new_table_.load();
+      return new_table->LookupInBucket(new_table->GetBucket(hash), key, hash,
+                                       value, guard);
+    }
+    return false;
+  }
+
+  // Like HashTableImpl::Bucket::Lookup, but skips deleted nodes and ignores
+  // the tags of the links.
+  template<typename K, typename Guard>
+  bool LookupInBucket(Bucket& bucket, const K& key, size_t hash,
+                      Value& value, Guard& guard) {
+    while (true) {
+      auto removal_count = bucket.removal_count.load();
+      auto* node = Untag(guard.Protect(0, bucket.head));
+      for (size_t hazard = 1; node != nullptr; hazard ^= 1) {
+        if (Guard::kValidates &&
+            bucket.removal_count.load() != removal_count) {
+          break;
+        }
+        auto* next = guard.Protect(hazard, node->next[current_index_]);
+        if (!HasTag(next, kDeleted) && node->Matches(key, hash, key_equal_)) {
+          value = node->value;
+          return true;
+        }
+        node = Untag(next);
+      }
+      if (node == nullptr) {
+        return false;
+      }
+    }
+  }
+
+  // Calls fn(key, value) for the nodes from `node` on that are not deleted
+  // and pass `filter`.
+  template<typename Function, typename Guard, typename Filter>
+  static void VisitChain(Node* node, size_t index, Function& fn, Guard& guard,
+                         Filter filter) {
+    node = Untag(node);
+    while (node != nullptr) {
+      auto* next = guard.Protect(0, node->next[index]);
+      if (!HasTag(next, kDeleted) && filter(node)) {
+        fn(node->key, node->value);
+      }
+      node = Untag(next);
+    }
+  }
+
+  // Tags every next link of the chain that starts at `node`, which nobody
+  // may link to anymore without the frozen tag, and calls
+  // `visitor(node, deleted)` for each node still in it. Nodes unlinked before
+  // their predecessor froze are skipped, as their unlinker retires them.
+  template<typename Visitor>
+  void FreezeChain(Node* node, Visitor visitor) {
+    while (node != nullptr) {
+      auto& link = node->next[current_index_];
+      auto* next = link.load();
+      while (!link.compare_exchange_weak(next, Tag(next, kFrozen))) {
+      }
+      // Read before the visitor, which may retire the node.
+      visitor(node, HasTag(next, kDeleted));
+      node = Untag(next);
+    }
+  }
+
+  // Prepends a node of a moved bucket. The new table is not being resized,
+  // so its chains are never frozen.
+  void LinkNode(Node* node) {
+    auto& head = GetBucket(node->hash).head;
+    auto* first = head.load();
+    do {
+      node->next[current_index_].store(first);
+    } while (!head.compare_exchange_weak(first, node));
+  }
+
+  void DeleteNode(Node* node) {
+    NodeTraits::destroy(node_allocator_, node);
+    NodeTraits::deallocate(node_allocator_, node, 1);
+  }
+
+ private:
+  Table* const master_hash_table_;
+  NodeAllocator node_allocator_;
+  const size_t current_index_ = 0;
+  const size_t bucket_count_;
+  const GrowthPolicy growth_policy_;
+  size_t constructed_bucket_count_ = 0;
+  Bucket* const buckets_;
+  Hash hasher_;
+  KeyEqual key_equal_;
+
+ private:
+  std::atomic<LockFreeHashTableImpl*> new_table_ = nullptr;
+  BucketMigration migration_{bucket_count_};
+};
+
+}  // namespace hash_table_internals
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace pool_allocator_internal {
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+// Free blocks of one size shared by all threads. Threads exchange whole
+// batches with it, so its mutex is taken once per kBatchSize operations.
+template<size_t kBlockSize>
+class BlockDepot {
+ public:
+  static constexpr size_t kBatchSize = 64;
+
+  // Never destroyed: tables with static storage may free nodes after every
+  // other static object is gone.
+  static BlockDepot& Instance() {
+    static auto* depot = new BlockDepot();
+    return *depot;
+  }
+
+  // Returns a list of kBatchSize blocks.
+  FreeBlock* PopBatch() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!batches_.empty()) {
+        auto* batch = batches_.back();
+        batches_.pop_back();
+        return batch;
+      }
+    }
+    return AllocateSlab();
+  }
+
+  // `batch` must be a list of kBatchSize blocks.
+  void PushBatch(FreeBlock* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    batches_.push_back(batch);
+  }
+
+ private:
+  // Slabs are never returned to the system, they are reused by later nodes.
+  FreeBlock* AllocateSlab() {
+    auto* slab = static_cast<char*>(::operator new(kBlockSize * kBatchSize));
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      slabs_.push_back(slab);
+    }
+    FreeBlock* head = nullptr;
+    for (size_t i = kBatchSize; i-- > 0;) {
+      head = new (slab + i * kBlockSize) FreeBlock{head};
+    }
+    return head;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<FreeBlock*> batches_;
+  // Blocks cached by exited threads are only reachable from here.
+  std::vector<char*> slabs_;
+};
+
+// Per-thread list of free blocks of one size. Trivially destructible, so it
+// stays usable while other thread_local objects are destroyed.
+template<size_t kBlockSize>
+struct ThreadCache {
+  using Depot = BlockDepot<kBlockSize>;
+
+  static ThreadCache& Get() {
+    static thread_local ThreadCache cache;
+    static thread_local Flusher flusher;
+    return cache;
+  }
+
+  void* Allocate() {
+    if (head == nullptr) {
+      head = Depot::Instance().PopBatch();
+      count = Depot::kBatchSize;
+    }
+    auto* block = head;
+    head = block->next;
+    --count;
+    return block;
+  }
+
+  void Deallocate(void* pointer) {
+    head = new (pointer) FreeBlock{head};
+    // Keeps a batch for the next allocations and gives the rest back, so a
+    // thread that only removes does not hoard the blocks of the inserters.
+    if (++count == 2 * Depot::kBatchSize) {
+      Depot::Instance().PushBatch(TakeBatch());
+    }
+  }
+
+  FreeBlock* TakeBatch() {
+    auto* batch = head;
+    auto* last = head;
+    for (size_t i = 1; i < Depot::kBatchSize; i++) {
+      last = last->next;
+    }
+    head = last->next;
+    last->next = nullptr;
+    count -= Depot::kBatchSize;
+    return batch;
+  }
+
+  // Gives full batches back to the depot when the thread exits. The remainder
+  // stays in the cache and is only lost for reuse.
+  struct Flusher {
+    ~Flusher() {
+      auto& cache = Get();
+      while (cache.count >= Depot::kBatchSize) {
+        Depot::Instance().PushBatch(cache.TakeBatch());
+      }
+    }
+  };
+
+  FreeBlock* head = nullptr;
+  size_t count = 0;
+};
+
+}  // namespace pool_allocator_internal
+
+// Standard allocator that serves single objects from per-thread caches of
+// fixed size blocks, refilled in slabs. Blocks freed by one thread are reused
+// by any other, as removers of a table are often not its inserters. Arrays
+// and over-aligned types go to operator new. Slabs are never returned to the
+// system, so the pool suits tables that stay near their peak size.
+template<typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U>& /*other*/) {}
+
+  T* allocate(size_t n) {
+    if (n != 1 || !kPooled) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(Cache::Get().Allocate());
+  }
+
+  void deallocate(T* pointer, size_t n) {
+    if (n != 1 || !kPooled) {
+      ::operator delete(pointer);
+      return;
+    }
+    Cache::Get().Deallocate(pointer);
+  }
+
+  template<typename U>
+  bool operator==(const PoolAllocator<U>& /*other*/) const { return true; }
+
+  template<typename U>
+  bool operator!=(const PoolAllocator<U>& /*other*/) const { return false; }
+
+ private:
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+  // Types of similar size share blocks.
+  static constexpr size_t kBlockSize =
+      (std::max(sizeof(T), sizeof(pool_allocator_internal::FreeBlock)) +
+       kAlignment - 1) / kAlignment * kAlignment;
+  static constexpr bool kPooled = alignof(T) <= kAlignment;
+
+  using Cache = pool_allocator_internal::ThreadCache<kBlockSize>;
+};
@@ -2,9 +2,24 @@
 
 #include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "thread_local.h"
 
 namespace rcu_lock_internal {
@@ -18,81 +33,191 @@ class CopyableAtomic : public std::atomic<T> {
       : std::atomic<T>::atomic(rhs.load()) {}
 };
 
-}  // namespace rcu_lock_internal
-
-class RCULock {
+// Fences for a store-load ordering whose two sides run at very different
+// rates. Light() only stops the compiler, and Heavy() makes up for it with
+// membarrier, which runs a full barrier on every running thread of the
+// process. Without membarrier both sides use a full fence.
+class AsymmetricFence {
  public:
-  void lock() { ReadLock(); }
+  static void Light() {
+    if (Expedited()) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } else {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
 
-  void unlock() { ReadUnlock(); }
+  static void Heavy() {
+#ifdef __linux__
+    if (Expedited()) {
+      syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+      return;
+    }
+#endif
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
 
-  void ReadLock() {
-    assert(*last_read_ % 2 == 0);
-    ++(*last_read_);
+ private:
+  static bool Expedited() {
+    static const bool expedited = Register();
+    return expedited;
   }
 
-  void ReadUnlock() {
-    assert(*last_read_ % 2 == 1);
-    ++(*last_read_);
+  static bool Register() {
+#ifdef __linux__
+    return syscall(SYS_membarrier,
+                   MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
   }
+};
 
-  void Synchronize() {
-    std::vector<std::atomic<uint64_t>*> current_timestamp;
-    std::vector<uint64_t> synced_timestamp;
-    for (auto& element : last_read_) {
-      synced_timestamp.push_back(element.load());
-      current_timestamp.push_back(&element);
+// Lets writers wait for a reader counter to change. A writer spins briefly,
+// then yields, then sleeps on a futex. Readers only pay for a load of
+// waiter_count_ on unlock, and a wake-up if a writer sleeps.
+class ReaderWaiter {
+ public:
+  // Returns once `counter` no longer holds `value`.
+  void WaitWhileEqual(const std::atomic<uint64_t>& counter, uint64_t value) {
+    for (size_t i = 0; i < kSpinCount; i++) {
+      if (counter.load() != value) {
+        return;
+      }
+      Pause();
     }
-    for (int i = 0; i < current_timestamp.size(); i++) {
-      if (!(synced_timestamp[i] & 1u)) {
-        continue;
+    for (size_t i = 0; i < kYieldCount; i++) {
+      if (counter.load() != value) {
+        return;
       }
-      while (current_timestamp[i]->load() == synced_timestamp[i]) {
-        std::this_thread::yield();
+      std::this_thread::yield();
+    }
+    waiter_count_.fetch_add(1);
+    // Pairs with the light fence of readers between their counter update and
+    // Notify.
+    AsymmetricFence::Heavy();
+    while (true) {
+      // Read before the counter: a reader that leaves afterwards changes it,
+      // so the futex does not sleep through the wake-up.
+      auto wake_count = wake_count_.load();
+      if (counter.load() != value) {
+        break;
       }
+      FutexWait(wake_count);
+    }
+    waiter_count_.fetch_sub(1);
+  }
+
+  // Called by readers after they changed their counter and issued at least a
+  // light fence.
+  void Notify() {
+    if (waiter_count_.load(std::memory_order_relaxed) != 0) {
+      wake_count_.fetch_add(1);
+      FutexWakeAll();
     }
   }
 
  private:
-  ThreadLocal<rcu_lock_internal::CopyableAtomic<uint64_t>> last_read_;
+  static constexpr size_t kSpinCount = 128;
+  static constexpr size_t kYieldCount = 16;
+
+  static void Pause() {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+  }
+
+  void FutexWait(uint32_t wake_count) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+            FUTEX_WAIT_PRIVATE, wake_count, nullptr, nullptr, 0);
+#else
+    (void)wake_count;
+    std::this_thread::yield();
+#endif
+  }
+
+  void FutexWakeAll() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+            FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+
+ private:
+  std::atomic<uint32_t> waiter_count_{0};
+  std::atomic<uint32_t> wake_count_{0};
 };
 
-class RCUPerBucketLock {
+}  // namespace rcu_lock_internal
+
+// Every thread keeps a counter that is odd inside a read-side critical
+// section. Synchronize waits until each counter that was odd has changed.
+// Only the owner writes a counter, so readers use plain stores; the store
+// that enters a critical section is ordered before its loads by an
+// asymmetric fence, whose expensive side Synchronize pays. A table takes
+// one such lock for all of its buckets, so the counters cost a cache line
+// per thread slot, whatever the number of buckets, and a resize allocates
+// none.
+class RCULock {
  public:
-  explicit RCUPerBucketLock(size_t bucket_count) : last_read_(bucket_count) {}
+  void lock() { ReadLock(); }
 
-  void lock(size_t bucket_number) { ReadLock(bucket_number); }
+  void unlock() { ReadUnlock(); }
 
-  void unlock(size_t bucket_number) { ReadUnlock(bucket_number); }
+  void ReadLock() {
+    auto& counter = *last_read_;
+    auto value = counter.load(std::memory_order_relaxed);
+    assert(value % 2 == 0);
+    counter.store(value + 1, std::memory_order_relaxed);
+    rcu_lock_internal::AsymmetricFence::Light();
+  }
 
-  void ReadLock(size_t bucket_number) {
-    assert((*last_read_)[bucket_number] % 2 == 0);
-    ++(*last_read_)[bucket_number];
+  void ReadUnlock() {
+    auto& counter = *last_read_;
+    auto value = counter.load(std::memory_order_relaxed);
+    assert(value % 2 == 1);
+    // Release: the loads of the critical section complete before a writer
+    // sees it end.
+    counter.store(value + 1, std::memory_order_release);
+    rcu_lock_internal::AsymmetricFence::Light();
+    waiter_.Notify();
   }
 
-  void ReadUnlock(size_t bucket_number) {
-    assert((*last_read_)[bucket_number] % 2 == 1);
-    ++(*last_read_)[bucket_number];
+  // Concurrent callers share grace periods: a caller waits for the first
+  // grace period that starts after it arrives, which a single caller runs for
+  // everybody who arrived before it started.
+  void Synchronize() {
+    // grace_period_sequence_ is odd while a grace period runs. If one is
+    // running, it may have missed the critical sections this caller waits
+    // for, so the next one has to end.
+    auto target = (grace_period_sequence_.load() + 3) & ~uint64_t{1};
+    std::unique_lock<std::mutex> lock(grace_period_mutex_);
+    while (grace_period_sequence_.load() < target) {
+      grace_period_sequence_.fetch_add(1);
+      WaitForReaders();
+      grace_period_sequence_.fetch_add(1);
+    }
   }
 
-  void Synchronize(size_t bucket_number) {
-    std::vector<std::atomic<uint64_t>*> current_timestamp;
-    std::vector<uint64_t> synced_timestamp;
+ private:
+  // A critical section that started after the scan reached its thread does
+  // not have to be waited for, but it is harmless.
+  void WaitForReaders() {
+    // Either a reader's counter update is visible now, or the critical
+    // section it starts sees everything the caller stored before.
+    rcu_lock_internal::AsymmetricFence::Heavy();
     for (auto& element : last_read_) {
-      synced_timestamp.push_back(element[bucket_number].load());
-      current_timestamp.push_back(&element[bucket_number]);
-    }
-    for (int i = 0; i < current_timestamp.size(); i++) {
-      if (!(synced_timestamp[i] & 1u)) {
-        continue;
-      }
-      while (current_timestamp[i]->load() == synced_timestamp[i]) {
-        std::this_thread::yield();
+      auto timestamp = element.load();
+      if (timestamp & 1u) {
+        waiter_.WaitWhileEqual(element, timestamp);
       }
     }
   }
 
  private:
-  ThreadLocal<std::vector<rcu_lock_internal::CopyableAtomic<uint64_t>>>
-      last_read_;
+  InheritingThreadLocal<rcu_lock_internal::CopyableAtomic<uint64_t>> last_read_;
+  rcu_lock_internal::ReaderWaiter waiter_;
+  std::mutex grace_period_mutex_;
+  std::atomic<uint64_t> grace_period_sequence_{0};
 };
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "deferred_reclaimer.h"
+#include "rcu_lock.h"
+#include "thread_local.h"
+
+// Reclamation policies decide how readers are protected from removed elements
+// being freed. Each policy has a Domain, owned by the table, which provides
+//   * lock() and unlock(): a read-side critical section, which keeps the
+//     structure of the table (the current storage, a resize in progress)
+//     alive;
+//   * Synchronize(): waits for every read-side critical section that started
+//     earlier. Must not be called inside one;
+//   * Retire(): frees an unlinked element once no reader can reach it. May be
+//     called inside a read-side critical section;
+//   * Throttle(): lets a writer wait for a reclamation backlog outside of
+//     read-side critical sections;
+//   * PendingCount(): how many retired elements are not freed yet, give or
+//     take a batch per thread;
+//   * WaitCount() and WaitTime(): grace periods the domain waited for on its
+//     own, outside of Synchronize, and the time they took;
+//   * Guard: a per-operation object whose Protect() loads a pointer to an
+//     element so that it stays alive while the guard does.
+
+namespace hash_table_internals {
+
+// Guard of the policies whose read-side critical sections protect elements
+// on their own.
+struct CriticalSectionGuard {
+  static constexpr bool kValidates = false;
+
+  template<typename Domain>
+  explicit CriticalSectionGuard(Domain& /*domain*/) {}
+
+  template<typename T>
+  T* Protect(size_t /*hazard*/, const std::atomic<T*>& source) {
+    return source.load(std::memory_order_acquire);
+  }
+};
+
+class RCUDomain {
+ public:
+  using Guard = CriticalSectionGuard;
+
+  void lock() { lock_.lock(); }
+
+  void unlock() { lock_.unlock(); }
+
+  void Synchronize() { lock_.Synchronize(); }
+
+  void Retire(const RetiredObject& retired) { reclaimer_.Retire(retired); }
+
+  void Throttle() { reclaimer_.Throttle(); }
+
+  size_t PendingCount() const { return reclaimer_.Backlog(); }
+
+  uint64_t WaitCount() const { return reclaimer_.WaitCount(); }
+
+  std::chrono::nanoseconds WaitTime() const { return reclaimer_.WaitTime(); }
+
+ private:
+  RCULock lock_;
+  DeferredReclaimer reclaimer_{lock_};
+};
+
+// Readers announce the global epoch they started in. A grace period is over
+// once every reader has announced a later epoch or left, which writers check
+// without waiting, so retired elements are freed by the writers themselves.
+class EpochDomain {
+ public:
+  using Guard = CriticalSectionGuard;
+
+  // Frees what is still retired. There must be no readers left.
+  ~EpochDomain() {
+    for (auto& limbo : limbos_) {
+      for (auto& [epoch, retired] : limbo) {
+        retired.Reclaim();
+      }
+    }
+  }
+
+  void lock() {
+    auto& announced = *announced_;
+    assert(announced.load(std::memory_order_relaxed) == kInactive);
+    // The epoch is read again after the announcement is visible, so it cannot
+    // advance twice past a reader that announced a stale one.
+    auto epoch = epoch_.load();
+    while (true) {
+      announced.store(epoch);
+      auto current = epoch_.load();
+      if (current == epoch) {
+        return;
+      }
+      epoch = current;
+    }
+  }
+
+  void unlock() { announced_->store(kInactive, std::memory_order_release); }
+
+  // Readers that started before may have announced the current epoch, which
+  // they stop holding back only after the epoch has advanced twice. The epoch
+  // is advanced the same way as by Retire, since an advance past an active
+  // reader would let writers free what it still sees.
+  void Synchronize() {
+    auto target = epoch_.load() + 2;
+    while (true) {
+      TryAdvance();
+      if (epoch_.load() >= target) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void Retire(const RetiredObject& retired) {
+    auto& limbo = *limbos_;
+    limbo.push_back({epoch_.load(), retired});
+    if (limbo.size() % kBatchSize == 0) {
+      TryAdvance();
+      ReclaimExpired(limbo);
+      limbo_sizes_->store(limbo.size(), std::memory_order_relaxed);
+    }
+  }
+
+  void Throttle() {}
+
+  size_t PendingCount() {
+    size_t pending_count = 0;
+    for (auto& limbo_size : limbo_sizes_) {
+      pending_count += limbo_size.load(std::memory_order_relaxed);
+    }
+    return pending_count;
+  }
+
+  // Writers only check whether readers have moved on, they never wait.
+  uint64_t WaitCount() const { return 0; }
+
+  std::chrono::nanoseconds WaitTime() const {
+    return std::chrono::nanoseconds(0);
+  }
+
+ private:
+  // Larger than every epoch, so inactive threads never hold an epoch back.
+  static constexpr uint64_t kInactive = UINT64_MAX;
+  static constexpr size_t kBatchSize = 64;
+
+  // Advances the epoch if every active reader has announced the current one.
+  void TryAdvance() {
+    auto epoch = epoch_.load();
+    for (auto& announced : announced_) {
+      if (announced.load() < epoch) {
+        return;
+      }
+    }
+    epoch_.compare_exchange_strong(epoch, epoch + 1);
+  }
+
+  // An element retired in epoch e may be seen by readers that announced e,
+  // which are gone once the epoch reaches e + 2.
+  void ReclaimExpired(std::vector<std::pair<uint64_t, RetiredObject>>& limbo) {
+    auto epoch = epoch_.load();
+    auto expired = std::partition(limbo.begin(), limbo.end(),
+                                  [epoch](const auto& element) {
+                                    return element.first + 2 > epoch;
+                                  });
+    for (auto it = expired; it != limbo.end(); ++it) {
+      it->second.Reclaim();
+    }
+    limbo.erase(expired, limbo.end());
+  }
+
+ private:
+  std::atomic<uint64_t> epoch_ = 0;
+  InheritingThreadLocal<rcu_lock_internal::CopyableAtomic<uint64_t>>
+      announced_{kInactive};
+  // Retired elements of a thread with the epoch they were retired in.
+  InheritingThreadLocal<std::vector<std::pair<uint64_t, RetiredObject>>>
+      limbos_;
+  // Sizes of the limbos, published for PendingCount after each batch.
+  InheritingThreadLocal<rcu_lock_internal::CopyableAtomic<size_t>>
+      limbo_sizes_{0};
+};
+
+// Readers publish every element they dereference in a hazard pointer, and an
+// element is freed once no hazard pointer refers to it, so a stalled reader
+// holds back only the elements it points to. The structure of the table is
+// still protected by epochs.
+class HazardPointerDomain {
+ public:
+  // Lock-free writers hold the predecessor, the current and the next node,
+  // and the head of the chain their search started from.
+  static constexpr size_t kHazardsPerThread = 4;
+
+ private:
+  using HazardArray =
+      std::array<rcu_lock_internal::CopyableAtomic<void*>, kHazardsPerThread>;
+
+ public:
+  class Guard {
+   public:
+    // Readers have to revalidate what they reached through a protected
+    // element, as it may have been unlinked meanwhile.
+    static constexpr bool kValidates = true;
+
+    explicit Guard(HazardPointerDomain& domain)
+        : hazards_(*domain.hazards_) {}
+
+    ~Guard() {
+      for (auto& hazard : hazards_) {
+        hazard.store(nullptr, std::memory_order_release);
+      }
+    }
+
+    // Replaces the element protected by hazard pointer `hazard`.
+    template<typename T>
+    T* Protect(size_t hazard, const std::atomic<T*>& source) {
+      auto* pointer = source.load();
+      while (true) {
+        hazards_[hazard].store(pointer);
+        auto* current = source.load();
+        if (current == pointer) {
+          return pointer;
+        }
+        pointer = current;
+      }
+    }
+
+   private:
+    HazardArray& hazards_;
+  };
+
+  // Frees what is still retired. There must be no readers left.
+  ~HazardPointerDomain() {
+    for (auto& retired_list : retired_) {
+      for (auto& retired : retired_list) {
+        retired.Reclaim();
+      }
+    }
+  }
+
+  void lock() { epochs_.lock(); }
+
+  void unlock() { epochs_.unlock(); }
+
+  void Synchronize() { epochs_.Synchronize(); }
+
+  void Retire(const RetiredObject& retired) {
+    auto& retired_list = *retired_;
+    retired_list.push_back(retired);
+    if (retired_list.size() % kScanThreshold == 0) {
+      Scan(retired_list);
+      retired_sizes_->store(retired_list.size(), std::memory_order_relaxed);
+    }
+  }
+
+  void Throttle() {}
+
+  size_t PendingCount() {
+    size_t pending_count = 0;
+    for (auto& retired_size : retired_sizes_) {
+      pending_count += retired_size.load(std::memory_order_relaxed);
+    }
+    return pending_count;
+  }
+
+  uint64_t WaitCount() const { return 0; }
+
+  std::chrono::nanoseconds WaitTime() const {
+    return std::chrono::nanoseconds(0);
+  }
+
+ private:
+  static constexpr size_t kScanThreshold = 64;
+  // Protected pointers may carry tags in their low bits, which objects are
+  // aligned enough never to use.
+  static constexpr uintptr_t kTagMask = 7;
+
+  void Scan(std::vector<RetiredObject>& retired_list) {
+    std::vector<void*> hazards;
+    for (auto& thread_hazards : hazards_) {
+      for (auto& hazard : thread_hazards) {
+        auto pointer = reinterpret_cast<uintptr_t>(hazard.load()) & ~kTagMask;
+        if (pointer != 0) {
+          hazards.push_back(reinterpret_cast<void*>(pointer));
+        }
+      }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    auto protected_end = std::partition(
+        retired_list.begin(), retired_list.end(),
+        [&hazards](const RetiredObject& retired) {
+          return std::binary_search(hazards.begin(), hazards.end(),
+                                    retired.object);
+        });
+    for (auto it = protected_end; it != retired_list.end(); ++it) {
+      it->Reclaim();
+    }
+    retired_list.erase(protected_end, retired_list.end());
+  }
+
+ private:
+  EpochDomain epochs_;
+  InheritingThreadLocal<HazardArray> hazards_{
+      HazardArray{nullptr, nullptr, nullptr, nullptr}};
+  InheritingThreadLocal<std::vector<RetiredObject>> retired_;
+  // Sizes of the retired lists, published for PendingCount after each scan.
+  InheritingThreadLocal<rcu_lock_internal::CopyableAtomic<size_t>>
+      retired_sizes_{0};
+};
+
+}  // namespace hash_table_internals
+
+// Counter based RCU; removed elements are freed in batches by a thread of the
+// table after a grace period.
+struct RCUReclamation {
+  using Domain = hash_table_internals::RCUDomain;
+};
+
+// Epoch based reclamation; cheaper read-side critical sections, and writers
+// free removed elements without waiting for readers.
+struct EpochReclamation {
+  using Domain = hash_table_internals::EpochDomain;
+};
+
+// Hazard pointers; readers pay for every element they visit, but the memory
+// held back by slow readers is bounded.
+struct HazardPointerReclamation {
+  using Domain = hash_table_internals::HazardPointerDomain;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "rcu_lock.h"
+#include "thread_local.h"
+
+namespace hash_table_internals {
+
+// Counter split into per-thread shards that are flushed into a shared total
+// once they drift by a batch, so updating it does not bounce a cache line
+// between writers.
+class ShardedCounter {
+ public:
+  // Returns true if the shard of the calling thread was flushed to the total.
+  bool Add(int64_t delta, int64_t batch) {
+    auto& shard = *shards_;
+    auto value = shard.load(std::memory_order_relaxed) + delta;
+    if (-batch < value && value < batch) {
+      shard.store(value, std::memory_order_relaxed);
+      return false;
+    }
+    shard.store(0, std::memory_order_relaxed);
+    total_.fetch_add(value);
+    return true;
+  }
+
+  // The flushed part of the counter; may lag behind by up to a batch per
+  // thread.
+  int64_t Total() const { return total_.load(); }
+
+  // Includes the unflushed shards. Still approximate while writers run.
+  int64_t Sum() {
+    auto sum = total_.load();
+    for (auto& shard : shards_) {
+      sum += shard.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  InheritingThreadLocal<rcu_lock_internal::CopyableAtomic<int64_t>> shards_{0};
+  std::atomic<int64_t> total_ = 0;
+};
+
+}  // namespace hash_table_internals
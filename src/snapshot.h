@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Serializers turn the elements of a table into the records of a snapshot
+// and back. Save appends the record of an element to `record`; Load parses
+// the record at the start of the `size` bytes at `data` and returns its
+// length, or 0 if it is malformed. Loading requires default constructible
+// keys and values.
+//
+// The default serializer copies the bytes of trivially copyable keys and
+// values.
+template<typename Key, typename Value>
+struct TrivialSerializer {
+  static_assert(std::is_trivially_copyable_v<Key> &&
+                    std::is_trivially_copyable_v<Value>,
+                "other types need a serializer of their own");
+
+  void Save(const Key& key, const Value& value, std::string& record) const {
+    record.append(reinterpret_cast<const char*>(&key), sizeof(Key));
+    record.append(reinterpret_cast<const char*>(&value), sizeof(Value));
+  }
+
+  size_t Load(const char* data, size_t size, Key& key, Value& value) const {
+    if (size < sizeof(Key) + sizeof(Value)) {
+      return 0;
+    }
+    std::memcpy(&key, data, sizeof(Key));
+    std::memcpy(&value, data + sizeof(Key), sizeof(Value));
+    return sizeof(Key) + sizeof(Value);
+  }
+};
+
+namespace hash_table_internals {
+
+// A snapshot file is this header followed by `record_count` records, all in
+// the byte order of the machine that wrote it.
+struct SnapshotHeader {
+  static constexpr uint64_t kMagic = 0x544f4853504e5348;  // "HSNPSHOT"
+  static constexpr uint32_t kVersion = 2;
+
+  uint64_t magic = kMagic;
+  uint32_t version = kVersion;
+  // Of Key and Value, which catch most loads into a table of another type.
+  uint32_t key_size = 0;
+  uint32_t value_size = 0;
+  uint32_t padding = 0;
+  uint64_t record_count = 0;
+  uint64_t records_size = 0;
+  // Of the records followed by this header with a zero checksum, so that a
+  // corrupted count is caught before it is trusted.
+  uint64_t checksum = 0;
+};
+
+// FNV-1a over 8 byte words, which keeps up with sequential reads, with a
+// shift so that the high bits of a word reach the low bits of the result.
+// Each step is a bijection of the state, so a single corrupted word always
+// changes the result. The data may be fed in pieces of any size.
+class SnapshotChecksum {
+ public:
+  void Update(const char* data, size_t size) {
+    while (size > 0 && pending_size_ > 0) {
+      AddByte(*data++);
+      --size;
+    }
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, data, sizeof(word));
+      Mix(word);
+      data += sizeof(word);
+    }
+    while (size-- > 0) {
+      AddByte(*data++);
+    }
+  }
+
+  // A trailing partial word counts as if padded with zeros.
+  uint64_t Value() const {
+    auto copy = *this;
+    if (copy.pending_size_ > 0) {
+      copy.Mix(copy.pending_);
+    }
+    return copy.hash_;
+  }
+
+ private:
+  static constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ull;
+  static constexpr uint64_t kPrime = 0x100000001b3ull;
+
+  void Mix(uint64_t word) {
+    hash_ = (hash_ ^ word) * kPrime;
+    hash_ ^= hash_ >> 32;
+  }
+
+  void AddByte(char byte) {
+    pending_ |= static_cast<uint64_t>(static_cast<uint8_t>(byte))
+                << (8 * pending_size_);
+    if (++pending_size_ == sizeof(uint64_t)) {
+      Mix(pending_);
+      pending_ = 0;
+      pending_size_ = 0;
+    }
+  }
+
+  uint64_t hash_ = kOffsetBasis;
+  uint64_t pending_ = 0;
+  size_t pending_size_ = 0;
+};
+
+// Writes a snapshot to a temporary file next to `path`, which replaces
+// `path` once the snapshot is complete, so a failed save leaves the previous
+// snapshot intact. Records are gathered in a buffer, which FlushIfFull
+// writes in large blocks.
+class SnapshotWriter {
+ public:
+  SnapshotWriter(const std::string& path, uint32_t key_size,
+                 uint32_t value_size)
+      : path_(path), temporary_path_(path + ".tmp"),
+        file_(std::fopen(temporary_path_.c_str(), "wb")) {
+    header_.key_size = key_size;
+    header_.value_size = value_size;
+    // Rewritten by Finish.
+    Write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  }
+
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+  ~SnapshotWriter() {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+      std::remove(temporary_path_.c_str());
+    }
+  }
+
+  // The record has to be appended to this and followed by EndRecord.
+  std::string& Record() { return buffer_; }
+
+  void EndRecord() { ++header_.record_count; }
+
+  // Writes the buffered records once there are enough of them. Kept apart
+  // from EndRecord, so that records can be gathered where no I/O may happen.
+  void FlushIfFull() {
+    if (buffer_.size() >= kBufferSize) {
+      Flush();
+    }
+  }
+
+  // Returns whether the snapshot has been written.
+  bool Finish() {
+    Flush();
+    checksum_.Update(reinterpret_cast<const char*>(&header_),
+                     sizeof(header_));
+    header_.checksum = checksum_.Value();
+    if (file_ == nullptr || std::fseek(file_, 0, SEEK_SET) != 0) {
+      return false;
+    }
+    Write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    bool written = !failed_ && std::fflush(file_) == 0 &&
+                   fsync(fileno(file_)) == 0;
+    written = std::fclose(file_) == 0 && written;
+    file_ = nullptr;
+    if (!written || std::rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+      std::remove(temporary_path_.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  void Flush() {
+    checksum_.Update(buffer_.data(), buffer_.size());
+    header_.records_size += buffer_.size();
+    Write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+  void Write(const char* data, size_t size) {
+    if (file_ == nullptr || std::fwrite(data, 1, size, file_) != size) {
+      failed_ = true;
+    }
+  }
+
+  const std::string path_;
+  const std::string temporary_path_;
+  std::FILE* file_;
+  bool failed_ = false;
+  SnapshotHeader header_;
+  SnapshotChecksum checksum_;
+  std::string buffer_;
+};
+
+// Maps a snapshot file into memory and checks its header and checksum. The
+// kernel is told that the file is read sequentially, so it reads ahead.
+class SnapshotReader {
+ public:
+  SnapshotReader(const std::string& path, uint32_t key_size,
+                 uint32_t value_size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 &&
+        static_cast<size_t>(status.st_size) >= sizeof(SnapshotHeader)) {
+      size_ = status.st_size;
+      auto* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const char*>(data);
+        madvise(data, size_, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+    valid_ = data_ != nullptr && Check(key_size, value_size);
+  }
+
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  ~SnapshotReader() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  bool IsValid() const { return valid_; }
+
+  uint64_t RecordCount() const { return header_.record_count; }
+
+  const char* Records() const { return data_ + sizeof(SnapshotHeader); }
+
+  size_t RecordsSize() const { return header_.records_size; }
+
+ private:
+  bool Check(uint32_t key_size, uint32_t value_size) {
+    std::memcpy(&header_, data_, sizeof(header_));
+    if (header_.magic != SnapshotHeader::kMagic ||
+        header_.version != SnapshotHeader::kVersion ||
+        header_.key_size != key_size || header_.value_size != value_size ||
+        header_.records_size != size_ - sizeof(SnapshotHeader)) {
+      return false;
+    }
+    auto header = header_;
+    header.checksum = 0;
+    SnapshotChecksum checksum;
+    checksum.Update(Records(), RecordsSize());
+    checksum.Update(reinterpret_cast<const char*>(&header), sizeof(header));
+    return checksum.Value() == header_.checksum;
+  }
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  SnapshotHeader header_;
+  bool valid_ = false;
+};
+
+}  // namespace hash_table_internals
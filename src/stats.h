@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "thread_local.h"
+
+// What HashTable::Stats() reports. Counters marked as collected stay zero
+// unless the table is built with CollectStats.
+struct HashTableStats {
+  // Of chain_lengths.
+  static constexpr size_t kMaxChainLength = 15;
+
+  // Operations since construction, collected. A MultiLookup counts each of
+  // its keys, and an update is any of InsertOrAssign, Update, Upsert and
+  // ComputeIfAbsent.
+  uint64_t lookup_count = 0;
+  uint64_t insert_count = 0;
+  uint64_t update_count = 0;
+  uint64_t remove_count = 0;
+
+  size_t size = 0;
+  size_t bucket_count = 0;
+  double load_factor = 0;
+  // chain_lengths[i] buckets hold i elements; the last entry also counts
+  // longer chains. During a resize only the buckets that have not moved yet
+  // are counted. An open addressing table counts its elements by the number
+  // of groups a lookup probes to reach them instead. Left empty with
+  // hazard pointers, which cannot keep a whole chain alive.
+  std::array<size_t, kMaxChainLength + 1> chain_lengths{};
+
+  // Finished resizes, and the time from their start to their end.
+  uint64_t resize_count = 0;
+  std::chrono::nanoseconds resize_time{0};
+  std::chrono::nanoseconds max_resize_time{0};
+
+  // Grace periods waited for, collected: by resizes, by the thread that
+  // frees removed elements, and by writers throttled until it catches up.
+  uint64_t synchronize_count = 0;
+  std::chrono::nanoseconds synchronize_time{0};
+
+  // Writers that found their bucket, or stripe, locked, collected.
+  uint64_t lock_wait_count = 0;
+  std::chrono::nanoseconds lock_wait_time{0};
+
+  // Removed elements that are not freed yet, give or take a batch per thread.
+  size_t pending_reclamation_count = 0;
+};
+
+namespace hash_table_internals {
+
+enum class StatsCounter : size_t {
+  kLookups,
+  kInserts,
+  kUpdates,
+  kRemoves,
+  kSynchronizes,
+  kSynchronizeNanoseconds,
+  kLockWaits,
+  kLockWaitNanoseconds,
+  kCount,
+};
+
+// Collects nothing; every call compiles down to the operation itself.
+class NoStatsRecorder {
+ public:
+  static constexpr bool kEnabled = false;
+
+  void Add(StatsCounter /*counter*/, uint64_t /*delta*/) {}
+
+  template<typename Function>
+  void Time(StatsCounter /*count*/, StatsCounter /*time*/,
+            Function function) {
+    function();
+  }
+
+  template<typename Lockable>
+  void Lock(Lockable& lock) {
+    lock.lock();
+  }
+
+  uint64_t Sum(StatsCounter /*counter*/) { return 0; }
+};
+
+// Every thread counts in a shard of its own, so counting is a plain load and
+// store of a cache line that no other thread writes.
+class StatsRecorder {
+ public:
+  static constexpr bool kEnabled = true;
+
+  void Add(StatsCounter counter, uint64_t delta) {
+    auto& value = shards_->counts[static_cast<size_t>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+  }
+
+  // Runs function(), counting it in `count` and its duration in `time`.
+  template<typename Function>
+  void Time(StatsCounter count, StatsCounter time, Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    Add(count, 1);
+    Add(time, duration.count());
+  }
+
+  // Only a lock that is already held is timed.
+  template<typename Lockable>
+  void Lock(Lockable& lock) {
+    if (!lock.try_lock()) {
+      Time(StatsCounter::kLockWaits, StatsCounter::kLockWaitNanoseconds,
+           [&] { lock.lock(); });
+    }
+  }
+
+  // Approximate while other threads count.
+  uint64_t Sum(StatsCounter counter) {
+    uint64_t sum = 0;
+    for (auto& shard : shards_) {
+      sum += shard.counts[static_cast<size_t>(counter)].load(
+          std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  struct Shard {
+    Shard() = default;
+
+    // ThreadLocal copies the initial shard for every thread.
+    Shard(const Shard& other) {
+      for (size_t i = 0; i < counts.size(); i++) {
+        counts[i].store(other.counts[i].load());
+      }
+    }
+
+    std::array<std::atomic<uint64_t>,
+               static_cast<size_t>(StatsCounter::kCount)> counts{};
+  };
+
+  InheritingThreadLocal<Shard> shards_;
+};
+
+}  // namespace hash_table_internals
+
+// Stats policies decide which counters of HashTableStats are collected.
+// The resize counters, the chain lengths and the reclamation backlog are
+// always reported, as they cost nothing per operation.
+struct NoStats {
+  using Recorder = hash_table_internals::NoStatsRecorder;
+};
+
+// Counts operations, grace periods and lock waits in per-thread counters.
+struct CollectStats {
+  using Recorder = hash_table_internals::StatsRecorder;
+};
@@ -1,111 +1,246 @@
 #pragma once
 
-#include <pthread.h>
-
+#include <array>
 #include <atomic>
 #include <cassert>
-#include <iostream>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <thread>
-#include <unordered_map>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace thread_local_internal {
+
+// Hands out slot indices to threads and takes them back when the threads
+// exit. The smallest free index is reused first, so indices stay below the
+// peak number of live threads, however many threads a pool has recycled.
+// Also numbers the threads, so that a slot can tell its owners apart.
+class SlotRegistry {
+ public:
+  static constexpr size_t kNoSlot = SIZE_MAX;
 
-template <typename T>
+  // Index of the calling thread that no other thread is ever given.
+  static size_t CurrentThreadId() {
+    static thread_local size_t id = Instance().thread_count_.fetch_add(1);
+    return id;
+  }
+
+  // Index of the calling thread.
+  static size_t CurrentSlot() {
+    auto& slot = Slot();
+    if (slot == kNoSlot) {
+      slot = Instance().Acquire();
+      // Constructed once per thread: a thread that touches a ThreadLocal
+      // after its releaser ran keeps the new index until the process exits.
+      static thread_local Releaser releaser;
+    }
+    return slot;
+  }
+
+ private:
+  struct Releaser {
+    ~Releaser() {
+      Instance().Release(Slot());
+      Slot() = kNoSlot;
+    }
+  };
+
+  // Never destroyed: threads may exit after every static object is gone.
+  static SlotRegistry& Instance() {
+    static auto* registry = new SlotRegistry();
+    return *registry;
+  }
+
+  // Trivially destructible, so it stays usable while other thread_local
+  // objects are destroyed.
+  static size_t& Slot() {
+    static thread_local size_t slot = kNoSlot;
+    return slot;
+  }
+
+  size_t Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_slots_.empty()) {
+      return slot_count_++;
+    }
+    auto slot = free_slots_.top();
+    free_slots_.pop();
+    return slot;
+  }
+
+  void Release(size_t slot) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    free_slots_.push(slot);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+      free_slots_;
+  size_t slot_count_ = 0;
+  std::atomic<size_t> thread_count_{0};
+};
+
+}  // namespace thread_local_internal
+
+// A value per thread, indexed by the slot of the thread, so iterating visits
+// at most as many values as there were live threads at once. Values outlive
+// their threads and are still visited by iteration until the slot is given
+// to another thread, which then starts from the initial value again. If
+// `kInheritValues`, it takes over the value of the exited thread instead.
+template <typename T, bool kInheritValues = false>
 class ThreadLocal {
  private:
-  struct Node {
-    Node(Node* next, T data)
-        : next(next), data(std::move(data)) {}
-    std::atomic<Node*> next;
-    T data;
+  using SlotRegistry = thread_local_internal::SlotRegistry;
+
+  // Padded, so that values of different threads never share a cache line.
+  struct alignas(64) Slot {
+    std::atomic<bool> constructed{false};
+    // Id of the thread that the value belongs to, unless `kInheritValues`.
+    size_t owner = SIZE_MAX;
+    std::optional<T> data;
   };
 
+  // Segment i holds 2^i slots, so segments are never reallocated while other
+  // threads access them.
+  static constexpr size_t kSegmentCount = 32;
+
  public:
   template <typename... Args>
-  ThreadLocal(Args&&... args) : default_data_(std::forward<Args>(args)...) {
-    auto error = pthread_key_create(&object_key_, nullptr);
-    assert(error == 0);
-    head_ = new Node(nullptr, default_data_);
-    tail_.store(head_.load());
-  }
+  ThreadLocal(Args&&... args) : default_data_(std::forward<Args>(args)...) {}
 
   ~ThreadLocal() {
-    clear_list();
-    assert(pthread_key_delete(object_key_) == 0);
+    for (auto& segment : segments_) {
+      delete[] segment.load();
+    }
   }
 
-  T& operator*() { return *check_or_create_new_vertex(); }
+  T& operator*() { return *Get(); }
 
-  T* operator->() { return check_or_create_new_vertex(); }
+  T* operator->() { return Get(); }
 
   class Iterator {
    public:
-    Iterator(Node* current) : current_(current) {}
+    Iterator(ThreadLocal* thread_local_value, size_t index, size_t end_index)
+        : thread_local_(thread_local_value), index_(index),
+          end_index_(end_index) {
+      SkipUnconstructed();
+    }
+
+    T& operator*() const { return *thread_local_->FindSlot(index_)->data; }
 
-    T& operator*() const { return current_->data; }
+    T* operator->() const { return &*thread_local_->FindSlot(index_)->data; }
 
-    T* operator->() const { return &(current_->data); }
+    void operator++() {
+      ++index_;
+      SkipUnconstructed();
+    }
 
-    void operator++() { current_ = current_->next; }
+    void operator++(int) { ++*this; }
 
-    void operator++(int) { current_ = current_->next; }
+    bool operator!=(const Iterator& rhs) const { return index_ != rhs.index_; }
 
-    bool operator!=(const Iterator& rhs) const {
-      return current_ != rhs.current_;
+   private:
+    void SkipUnconstructed() {
+      while (index_ < end_index_) {
+        auto* slot = thread_local_->FindSlot(index_);
+        if (slot != nullptr &&
+            slot->constructed.load(std::memory_order_acquire)) {
+          return;
+        }
+        ++index_;
+      }
+      index_ = SlotRegistry::kNoSlot;
     }
 
-   private:
-    Node* current_;
+    ThreadLocal* thread_local_;
+    size_t index_;
+    size_t end_index_;
   };
 
-  Iterator begin() { return Iterator(head_.load()->next.load()); }
+  // Values of threads that start during the iteration may be skipped.
+  Iterator begin() { return Iterator(this, 0, slot_count_.load()); }
 
-  Iterator end() { return Iterator(nullptr); }
+  Iterator end() { return Iterator(this, SlotRegistry::kNoSlot, 0); }
 
+  // Resets the values of all threads. Must not run concurrently with any
+  // other access.
   void clear() {
-    clear_list();
-    head_ = new Node(nullptr, default_data_);
-    tail_.store(head_.load());
-    pthread_key_delete(object_key_);
-    assert(pthread_key_create(&object_key_, nullptr) == 0);
+    for (size_t i = 0; i < slot_count_.load(); i++) {
+      if (auto* slot = FindSlot(i)) {
+        slot->data.reset();
+        slot->constructed.store(false);
+      }
+    }
   }
 
  private:
-  void clear_list() {
-    while (head_ != nullptr) {
-      Node* next = head_.load()->next.load();
-      delete head_;
-      head_ = next;
-    }
+  static std::pair<size_t, size_t> Locate(size_t index) {
+    size_t segment = 63 - __builtin_clzll(index + 1);
+    return {segment, index + 1 - (size_t{1} << segment)};
   }
 
-  Node* get_pointer() {
-    return static_cast<Node*>(pthread_getspecific(object_key_));
+  // Returns nullptr if the segment of `index` is not allocated yet.
+  Slot* FindSlot(size_t index) {
+    auto [segment, offset] = Locate(index);
+    auto* slots = segments_[segment].load(std::memory_order_acquire);
+    return slots == nullptr ? nullptr : &slots[offset];
   }
 
-  void set_pointer(Node* pointer) {
-    pthread_setspecific(object_key_, static_cast<void*>(pointer));
+  T* Get() {
+    auto index = SlotRegistry::CurrentSlot();
+    auto* slot = FindSlot(index);
+    if (slot == nullptr) {
+      slot = AllocateSlot(index);
+    }
+    // Only written by this thread, or by threads that held the slot before,
+    // which handed it over through the registry.
+    if (!slot->constructed.load(std::memory_order_relaxed)) {
+      Construct(*slot, index);
+    } else if constexpr (!kInheritValues) {
+      auto thread_id = SlotRegistry::CurrentThreadId();
+      if (slot->owner != thread_id) {
+        *slot->data = default_data_;
+        slot->owner = thread_id;
+      }
+    }
+    return &*slot->data;
   }
 
-  T* check_or_create_new_vertex() {
-    Node* pointer = get_pointer();
-    if (pointer == nullptr) {
-      Node* new_node_ptr = new Node(nullptr, default_data_);
-      pointer = new_node_ptr;
-      set_pointer(new_node_ptr);
-      Node* expected = nullptr;
-      while (
-          !tail_.load()->next.compare_exchange_strong(expected, new_node_ptr)) {
-        expected = nullptr;
-        std::this_thread::yield();
-      }
-      tail_.store(tail_.load()->next.load());
+  Slot* AllocateSlot(size_t index) {
+    auto [segment, offset] = Locate(index);
+    assert(segment < kSegmentCount);
+    auto* slots = new Slot[size_t{1} << segment];
+    Slot* expected = nullptr;
+    if (!segments_[segment].compare_exchange_strong(expected, slots)) {
+      delete[] slots;
+      slots = expected;
     }
-    return &(pointer->data);
+    return &slots[offset];
   }
 
-  std::atomic<Node*> head_{nullptr};
-  std::atomic<Node*> tail_{nullptr};
-  pthread_key_t object_key_{0};
+  void Construct(Slot& slot, size_t index) {
+    if constexpr (!kInheritValues) {
+      slot.owner = SlotRegistry::CurrentThreadId();
+    }
+    slot.data.emplace(default_data_);
+    slot.constructed.store(true, std::memory_order_release);
+    auto slot_count = slot_count_.load();
+    while (slot_count <= index &&
+           !slot_count_.compare_exchange_weak(slot_count, index + 1)) {
+    }
+  }
+
+  std::array<std::atomic<Slot*>, kSegmentCount> segments_{};
+  // One more than the largest index of a constructed slot.
+  std::atomic<size_t> slot_count_{0};
   T default_data_;
 };
+
+// For per-thread state that the next owner of a slot must take over, such as
+// counters whose sum is all that matters or lists of objects to free.
+template <typename T>
+using InheritingThreadLocal = ThreadLocal<T, /*kInheritValues =*/ true>;
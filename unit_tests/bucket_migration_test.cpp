@@ -0,0 +1,56 @@
+#include "bucket_migration.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using hash_table_internals::BucketMigration;
+
+TEST(BucketMigration, NothingMovesBeforeOpen) {
+  BucketMigration migration(10);
+  ASSERT_FALSE(migration.Move(100, [](size_t) { FAIL(); }));
+  migration.Open();
+  size_t moved_count = 0;
+  ASSERT_TRUE(migration.Move(100, [&](size_t) { ++moved_count; }));
+  ASSERT_EQ(moved_count, 10);
+  ASSERT_TRUE(migration.Move(100, [](size_t) { FAIL(); }));
+}
+
+TEST(BucketMigration, RespectsBudget) {
+  BucketMigration migration(1000);
+  migration.Open();
+  std::vector<size_t> moved;
+  ASSERT_FALSE(migration.Move(7, [&](size_t i) { moved.push_back(i); }));
+  ASSERT_EQ(moved, std::vector<size_t>({0, 1, 2, 3, 4, 5, 6}));
+  while (!migration.Move(300, [&](size_t i) { moved.push_back(i); })) {
+  }
+  ASSERT_EQ(moved.size(), 1000);
+  for (size_t i = 0; i < moved.size(); ++i) {
+    ASSERT_EQ(moved[i], i);
+  }
+}
+
+// Every bucket is moved exactly once, and every thread with budget left
+// returns only once all are.
+TEST(BucketMigration, ManyThreads) {
+  const size_t kBuckets = 100000;
+  BucketMigration migration(kBuckets);
+  std::vector<std::atomic<int>> moves(kBuckets);
+  migration.Open();
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      size_t budget = t == 0 ? 10 : SIZE_MAX;
+      while (!migration.Move(budget, [&](size_t i) { ++moves[i]; })) {
+        ASSERT_EQ(budget, 10);
+      }
+      for (auto& count : moves) {
+        ASSERT_EQ(count.load(), 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
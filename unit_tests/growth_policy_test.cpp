@@ -0,0 +1,84 @@
+#include "growth_policy.h"
+#include "hash_table.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+TEST(PowerOfTwoGrowth, BucketCounts) {
+  ASSERT_EQ(PowerOfTwoGrowth::RoundBucketCount(0), 1);
+  ASSERT_EQ(PowerOfTwoGrowth::RoundBucketCount(1), 1);
+  ASSERT_EQ(PowerOfTwoGrowth::RoundBucketCount(17), 32);
+  ASSERT_EQ(PowerOfTwoGrowth::GrownBucketCount(32), 64);
+  ASSERT_EQ(PowerOfTwoGrowth::ShrunkBucketCount(32), 16);
+  ASSERT_EQ(PowerOfTwoGrowth::ShrunkBucketCount(1), 1);
+}
+
+// Consecutive integers, which std::hash maps to themselves, fill every bucket
+// evenly.
+TEST(PowerOfTwoGrowth, SpreadsIdentityHashes) {
+  for (size_t bucket_count = 1; bucket_count <= 1024; bucket_count *= 2) {
+    PowerOfTwoGrowth growth(bucket_count);
+    std::vector<size_t> sizes(bucket_count);
+    for (size_t hash = 0; hash < 16 * bucket_count; ++hash) {
+      auto index = growth.BucketIndex(hash);
+      ASSERT_LT(index, bucket_count);
+      ++sizes[index];
+    }
+    for (auto size : sizes) {
+      ASSERT_GE(size, 8);
+      ASSERT_LE(size, 24);
+    }
+  }
+}
+
+TEST(PrimeGrowth, BucketCounts) {
+  ASSERT_EQ(PrimeGrowth::RoundBucketCount(1), 2);
+  ASSERT_EQ(PrimeGrowth::RoundBucketCount(12), 23);
+  ASSERT_EQ(PrimeGrowth::GrownBucketCount(23), 47);
+  ASSERT_EQ(PrimeGrowth::ShrunkBucketCount(23), 11);
+  ASSERT_EQ(PrimeGrowth::ShrunkBucketCount(2), 2);
+}
+
+TEST(PrimeGrowth, MatchesModulo) {
+  std::mt19937_64 random(42);
+  for (size_t bucket_count = 1; bucket_count < 1000000000;
+       bucket_count = PrimeGrowth::GrownBucketCount(bucket_count)) {
+    PrimeGrowth growth(bucket_count);
+    for (size_t i = 0; i < 1000; ++i) {
+      size_t hash = random();
+      auto folded = static_cast<uint32_t>(hash ^ (hash >> 32));
+      ASSERT_EQ(growth.BucketIndex(hash), folded % bucket_count);
+    }
+  }
+}
+
+template<typename Backend, typename GrowthPolicy>
+void CheckGrowthPolicy() {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  HashTable<int, int, Backend, PoolAllocator<std::pair<const int, int>>,
+            RCUReclamation, std::hash<int>, std::equal_to<int>,
+            GrowthPolicy> ht(3, options);
+
+  const int kRange = 10000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  ASSERT_EQ(ht.Size(), 0);
+}
+
+TEST(GrowthPolicy, Tables) {
+  CheckGrowthPolicy<ChainingBackend, PowerOfTwoGrowth>();
+  CheckGrowthPolicy<ChainingBackend, PrimeGrowth>();
+  CheckGrowthPolicy<LockFreeChainingBackend, PowerOfTwoGrowth>();
+  CheckGrowthPolicy<LockFreeChainingBackend, PrimeGrowth>();
+  CheckGrowthPolicy<OpenAddressingBackend, PrimeGrowth>();
+}
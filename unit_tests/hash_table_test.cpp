@@ -1,5 +1,129 @@
 #include "hash_table.h"
 #include <gtest/gtest.h>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CountedKey {
+  int value;
+
+  bool operator==(const CountedKey& rhs) const { return value == rhs.value; }
+};
+
+std::atomic<size_t> counted_key_hash_calls{0};
+
+std::atomic<int64_t> live_allocations{0};
+
+// Stands in for an arena: counts the blocks it hands out.
+template<typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+
+  template<typename U>
+  CountingAllocator(const CountingAllocator<U>& /*other*/) {}
+
+  T* allocate(size_t n) {
+    live_allocations.fetch_add(n);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* pointer, size_t n) {
+    live_allocations.fetch_sub(n);
+    std::allocator<T>().deallocate(pointer, n);
+  }
+
+  template<typename U>
+  bool operator==(const CountingAllocator<U>& /*other*/) const { return true; }
+
+  template<typename U>
+  bool operator!=(const CountingAllocator<U>& /*other*/) const { return false; }
+};
+
+// Hashes and compares strings without building std::string from the other
+// string types.
+struct StringHash {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view key) const {
+    return std::hash<std::string_view>()(key);
+  }
+};
+
+struct StringEqual {
+  using is_transparent = void;
+
+  bool operator()(std::string_view lhs, std::string_view rhs) const {
+    return lhs == rhs;
+  }
+};
+
+// Keys that differ only in the case of their letters are equal.
+struct CaseInsensitiveHash {
+  size_t operator()(const std::string& key) const {
+    std::string lower = key;
+    for (auto& c : lower) {
+      c = std::tolower(c);
+    }
+    return std::hash<std::string>()(lower);
+  }
+};
+
+struct CaseInsensitiveEqual {
+  bool operator()(const std::string& lhs, const std::string& rhs) const {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                      [](char a, char b) {
+                        return std::tolower(a) == std::tolower(b);
+                      });
+  }
+};
+
+// Counts how its instances are made.
+struct TrackedValue {
+  static inline size_t constructions = 0;
+  static inline size_t copies = 0;
+
+  explicit TrackedValue(int value = 0) : value(value) { ++constructions; }
+
+  TrackedValue(int first, int second) : value(first + second) {
+    ++constructions;
+  }
+
+  TrackedValue(const TrackedValue& other) : value(other.value) { ++copies; }
+
+  TrackedValue(TrackedValue&& other) = default;
+
+  TrackedValue& operator=(const TrackedValue& other) {
+    value = other.value;
+    ++copies;
+    return *this;
+  }
+
+  int value;
+};
+
+}  // namespace
+
+namespace std {
+
+template <>
+struct hash<CountedKey> {
+  size_t operator()(const CountedKey& key) const {
+    counted_key_hash_calls.fetch_add(1);
+    return hash<int>()(key.value);
+  }
+};
+
+}  // namespace std
 
 TEST(HashTable, API) {
   HashTable<std::string, std::string> ht(1);
@@ -70,3 +194,906 @@ TEST(HashTable, MultipleKeys) {
     ASSERT_FALSE(ht.Lookup(std::to_string(i), value));
   }
 }
+
+TEST(HashTable, IncrementalResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  options.incremental_resize_step = 1;
+  HashTable<int, int> ht(1, options);
+
+  const int kRange = 1000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    for (int j = 0; j <= i; j += 7) {
+      int value;
+      ASSERT_TRUE(ht.Lookup(j, value));
+      ASSERT_EQ(value, j);
+    }
+  }
+
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i % 2 == 1);
+  }
+}
+
+TEST(HashTable, ClearDuringIncrementalResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  HashTable<int, int> ht(1, options);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  ht.Clear();
+
+  for (int i = 0; i < 100; ++i) {
+    int value;
+    ASSERT_FALSE(ht.Lookup(i, value));
+  }
+  ASSERT_TRUE(ht.Insert(1, 1));
+}
+
+TEST(HashTable, BackgroundResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  HashTable<int, int> ht(1, options);
+
+  const int kRange = 10000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+    ASSERT_TRUE(ht.Remove(i));
+  }
+}
+
+TEST(HashTable, DestroyDuringBackgroundResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  options.incremental_resize_step = 1;
+
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    HashTable<int, std::string> ht(1, options);
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_TRUE(ht.Insert(i, std::to_string(i)));
+    }
+  }
+}
+
+TEST(HashTable, ShrinkAfterDrain) {
+  HashTable<int, int> ht(1);
+
+  const int kRange = 10000;
+  const int kKept = 10;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = kKept; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i < kKept);
+  }
+  for (int i = kKept; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+}
+
+TEST(HashTable, Size) {
+  HashTable<int, int> ht(1);
+  ASSERT_EQ(ht.Size(), 0);
+
+  const int kRange = 1000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    ASSERT_FALSE(ht.Insert(i, i));
+  }
+  ASSERT_EQ(ht.Size(), kRange);
+
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  ASSERT_EQ(ht.Size(), kRange / 2);
+
+  ht.Clear();
+  ASSERT_EQ(ht.Size(), 0);
+}
+
+TEST(HashTable, SizeFromDifferentThreads) {
+  HashTable<int, int> ht(1);
+
+  const int kThreads = 8;
+  const int kKeysPerThread = 1000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&ht, t] {
+      for (int i = 0; i < kKeysPerThread; ++i) {
+        ASSERT_TRUE(ht.Insert(t * kKeysPerThread + i, i));
+      }
+      for (int i = 0; i < kKeysPerThread; i += 4) {
+        ASSERT_TRUE(ht.Remove(t * kKeysPerThread + i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(ht.Size(), kThreads * kKeysPerThread * 3 / 4);
+}
+
+TEST(HashTable, HashIsComputedOncePerOperation) {
+  HashTable<CountedKey, int> ht(1);
+  counted_key_hash_calls = 0;
+
+  const int kRange = 1000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert({i}, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup({i}, value));
+    ASSERT_TRUE(ht.Remove({i}));
+  }
+
+  // Resizes reuse the cached hashes.
+  ASSERT_EQ(counted_key_hash_calls.load(), 3 * kRange);
+}
+
+// Tests that run once per backend, named after it.
+template<typename Backend>
+class HashTableBackendTest : public testing::Test {};
+
+struct BackendName {
+  template<typename Backend>
+  static std::string GetName(int /*index*/) {
+    if constexpr (std::is_same_v<Backend, ChainingBackend>) {
+      return "Chaining";
+    } else if constexpr (std::is_same_v<Backend, LockFreeChainingBackend>) {
+      return "LockFreeChaining";
+    } else {
+      return "OpenAddressing";
+    }
+  }
+};
+
+using Backends = testing::Types<ChainingBackend, LockFreeChainingBackend,
+                                OpenAddressingBackend>;
+TYPED_TEST_SUITE(HashTableBackendTest, Backends, BackendName);
+
+template<typename Backend, typename Reclamation = RCUReclamation>
+void CheckCustomAllocator() {
+  const int kRange = 1000;
+  {
+    HashTable<int, int, Backend, CountingAllocator<std::pair<const int, int>>,
+              Reclamation> ht(1);
+    for (int i = 0; i < kRange; ++i) {
+      ASSERT_TRUE(ht.Insert(i, i));
+    }
+    ASSERT_EQ(live_allocations.load(), kRange);
+    for (int i = 0; i < kRange; i += 2) {
+      ASSERT_TRUE(ht.Remove(i));
+    }
+    // Removed nodes are freed once their grace period is over.
+    ASSERT_GE(live_allocations.load(), kRange / 2);
+  }
+  ASSERT_EQ(live_allocations.load(), 0);
+}
+
+TYPED_TEST(HashTableBackendTest, CustomAllocator) {
+  CheckCustomAllocator<TypeParam>();
+}
+
+TYPED_TEST(HashTableBackendTest, ReclamationPolicies) {
+  CheckCustomAllocator<TypeParam, EpochReclamation>();
+  CheckCustomAllocator<TypeParam, HazardPointerReclamation>();
+}
+
+TYPED_TEST(HashTableBackendTest, HeterogeneousLookup) {
+  using Backend = TypeParam;
+  HashTable<std::string, int, Backend,
+            PoolAllocator<std::pair<const std::string, int>>, RCUReclamation,
+            StringHash, StringEqual> ht(1);
+  const int kRange = 1000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(std::to_string(i), i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    auto key = std::to_string(i);
+    int value;
+    ASSERT_TRUE(ht.Lookup(std::string_view(key), value));
+    ASSERT_EQ(value, i);
+    ASSERT_TRUE(ht.Lookup(key.c_str(), value));
+    ASSERT_EQ(value, i);
+  }
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(std::string_view(std::to_string(i))));
+  }
+  int value;
+  ASSERT_FALSE(ht.Lookup(std::string_view("0"), value));
+  ASSERT_TRUE(ht.Lookup(std::string_view("1"), value));
+  ASSERT_EQ(ht.Size(), kRange / 2);
+}
+
+TYPED_TEST(HashTableBackendTest, CustomHashAndKeyEqual) {
+  using Backend = TypeParam;
+  HashTable<std::string, int, Backend,
+            PoolAllocator<std::pair<const std::string, int>>, RCUReclamation,
+            CaseInsensitiveHash, CaseInsensitiveEqual> ht(1);
+  ASSERT_TRUE(ht.Insert("Key", 1));
+  ASSERT_FALSE(ht.Insert("KEY", 2));
+  int value;
+  ASSERT_TRUE(ht.Lookup("key", value));
+  ASSERT_EQ(value, 1);
+  ASSERT_TRUE(ht.Remove("kEy"));
+  ASSERT_FALSE(ht.Lookup("Key", value));
+}
+
+TYPED_TEST(HashTableBackendTest, InPlaceConstruction) {
+  using Backend = TypeParam;
+  using Allocator = CountingAllocator<std::pair<const int, TrackedValue>>;
+  HashTable<int, TrackedValue, Backend, Allocator> ht(1);
+  TrackedValue::constructions = 0;
+  TrackedValue::copies = 0;
+
+  ASSERT_TRUE(ht.Insert(1, TrackedValue(1)));
+  ASSERT_TRUE(ht.TryEmplace(2, 1, 1));
+  ASSERT_TRUE(ht.TryEmplace(3, 3));
+  ASSERT_EQ(TrackedValue::constructions, 3);
+  ASSERT_EQ(TrackedValue::copies, 0);
+
+  auto allocations = live_allocations.load();
+  ASSERT_FALSE(ht.TryEmplace(2, 5));
+  ASSERT_FALSE(ht.Insert(1, TrackedValue(5)));
+  ASSERT_EQ(live_allocations.load(), allocations);
+  // Only the temporary of the second call.
+  ASSERT_EQ(TrackedValue::constructions, 4);
+
+  for (int i = 1; i <= 3; ++i) {
+    TrackedValue value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value.value, i);
+  }
+}
+
+TEST(HashTable, KeyIsMovedOnlyIfInserted) {
+  HashTable<std::string, std::string> ht(1);
+  std::string key(100, 'k');
+  std::string value(100, 'v');
+  ASSERT_TRUE(ht.Insert(std::move(key), std::move(value)));
+  // Moved from, as the key was new.
+  ASSERT_TRUE(key.empty());
+  std::string found;
+  ASSERT_TRUE(ht.Lookup(std::string(100, 'k'), found));
+  ASSERT_EQ(found, std::string(100, 'v'));
+
+  key = std::string(100, 'k');
+  ASSERT_FALSE(ht.TryEmplace(std::move(key), "other"));
+  // Left alone, as the key was present.
+  ASSERT_EQ(key, std::string(100, 'k'));
+}
+
+TYPED_TEST(HashTableBackendTest, Upserts) {
+  using Backend = TypeParam;
+  HashTable<int, std::string, Backend> ht(1);
+  std::string value;
+
+  ASSERT_TRUE(ht.InsertOrAssign(1, "one"));
+  ASSERT_FALSE(ht.InsertOrAssign(1, "uno"));
+  ASSERT_TRUE(ht.Lookup(1, value));
+  ASSERT_EQ(value, "uno");
+
+  ASSERT_FALSE(ht.Update(2, [](std::string& v) { v += "!"; }));
+  ASSERT_FALSE(ht.Lookup(2, value));
+  ASSERT_TRUE(ht.Update(1, [](std::string& v) { v += "!"; }));
+  ASSERT_TRUE(ht.Lookup(1, value));
+  ASSERT_EQ(value, "uno!");
+
+  auto insert = [] { return std::string("two"); };
+  auto update = [](std::string& v) { v = "dos"; };
+  ASSERT_TRUE(ht.Upsert(2, insert, update));
+  ASSERT_TRUE(ht.Lookup(2, value));
+  ASSERT_EQ(value, "two");
+  ASSERT_FALSE(ht.Upsert(2, insert, update));
+  ASSERT_TRUE(ht.Lookup(2, value));
+  ASSERT_EQ(value, "dos");
+
+  size_t factory_calls = 0;
+  auto factory = [&] {
+    ++factory_calls;
+    return std::string("three");
+  };
+  ASSERT_EQ(ht.ComputeIfAbsent(3, factory), "three");
+  ASSERT_EQ(ht.ComputeIfAbsent(3, factory), "three");
+  ASSERT_EQ(ht.ComputeIfAbsent(1, factory), "uno!");
+  ASSERT_EQ(factory_calls, 1);
+  ASSERT_EQ(ht.Size(), 3);
+}
+
+// Updates of the same keys from many threads are never lost, and readers
+// always see a whole value.
+template<typename Backend, typename Reclamation = RCUReclamation>
+void CheckConcurrentUpdates() {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  HashTable<int, std::string, Backend,
+            PoolAllocator<std::pair<const int, std::string>>, Reclamation>
+      ht(1, options);
+
+  const int kThreads = 4;
+  const int kKeys = 64;
+  const int kRounds = 100;
+
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    while (!done.load()) {
+      for (int i = 0; i < kKeys; ++i) {
+        std::string value;
+        if (ht.Lookup(i, value)) {
+          ASSERT_EQ(value.find_first_not_of('x'), std::string::npos);
+        }
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kThreads; ++t) {
+    writers.emplace_back([&] {
+      for (int round = 0; round < kRounds; ++round) {
+        for (int i = 0; i < kKeys; ++i) {
+          ht.Upsert(i, [] { return std::string("x"); },
+                    [](std::string& value) { value += 'x'; });
+        }
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  for (int i = 0; i < kKeys; ++i) {
+    std::string value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value.size(), kThreads * kRounds);
+  }
+}
+
+TYPED_TEST(HashTableBackendTest, ConcurrentUpdates) {
+  CheckConcurrentUpdates<TypeParam>();
+  CheckConcurrentUpdates<TypeParam, HazardPointerReclamation>();
+}
+
+// MultiLookup agrees with Lookup, also while buckets are being moved.
+template<typename Backend, typename Reclamation = RCUReclamation>
+void CheckMultiLookup() {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  HashTable<int, int, Backend, PoolAllocator<std::pair<const int, int>>,
+            Reclamation>
+      ht(1, options);
+
+  // Not a multiple of the batch size.
+  constexpr int kKeys = 1000;
+  std::array<int, kKeys> keys;
+  std::array<int, kKeys> values;
+  std::array<bool, kKeys> found;
+  for (int i = 0; i < kKeys; ++i) {
+    keys[i] = i;
+  }
+  ASSERT_EQ(ht.MultiLookup(keys.data(), 0, values.data(), found.data()), 0);
+
+  for (int i = 0; i < kKeys; i += 2) {
+    ht.Insert(i, i * 10);
+    size_t found_count = ht.MultiLookup(keys.data(), kKeys, values.data(),
+                                        found.data());
+    ASSERT_EQ(found_count, i / 2 + 1);
+    for (int j = 0; j < kKeys; ++j) {
+      int value;
+      ASSERT_EQ(found[j], ht.Lookup(j, value));
+      if (found[j]) {
+        ASSERT_EQ(values[j], value);
+      }
+    }
+  }
+}
+
+TYPED_TEST(HashTableBackendTest, MultiLookup) {
+  CheckMultiLookup<TypeParam>();
+  CheckMultiLookup<TypeParam, HazardPointerReclamation>();
+}
+
+// Elements that stay in the table are visited exactly once, also while
+// other elements are inserted and removed and the table grows and shrinks.
+TYPED_TEST(HashTableBackendTest, ForEach) {
+  using Backend = TypeParam;
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  options.incremental_resize_step = 4;
+  HashTable<int, int, Backend> ht(1, options);
+
+  ht.ForEach([](int, int) { FAIL(); });
+
+  const int kStable = 1000;
+  const int kChurn = 5000;
+  for (int i = 0; i < kStable; ++i) {
+    ht.Insert(i, i);
+  }
+
+  auto check = [&] {
+    std::vector<int> visits(kStable, 0);
+    ht.ForEach([&](int key, int value) {
+      ASSERT_EQ(key, value);
+      if (key < kStable) {
+        ++visits[key];
+      }
+    });
+    for (int i = 0; i < kStable; ++i) {
+      ASSERT_EQ(visits[i], 1) << i;
+    }
+  };
+
+  // Stops at every stage of the resizes.
+  for (int i = kStable; i < kStable + kChurn; ++i) {
+    ht.Insert(i, i);
+    if (i % 16 == 0) {
+      check();
+    }
+  }
+  for (int i = kStable; i < kStable + kChurn; ++i) {
+    ht.Remove(i);
+    if (i % 16 == 0) {
+      check();
+    }
+  }
+
+  std::atomic<int> cycles = 0;
+  std::thread writer([&] {
+    while (cycles.load() < 3) {
+      for (int i = kStable; i < kStable + kChurn; ++i) {
+        ht.Insert(i, i);
+      }
+      for (int i = kStable; i < kStable + kChurn; ++i) {
+        ht.Remove(i);
+      }
+      ++cycles;
+    }
+  });
+  while (cycles.load() < 3) {
+    check();
+  }
+  writer.join();
+}
+
+// Writers that run into a resize move buckets along with the resizer, while
+// readers keep finding every element that stays in the table.
+TYPED_TEST(HashTableBackendTest, WritersShareResizes) {
+  using Backend = TypeParam;
+  HashTable<int, int, Backend> ht(1);
+
+  const int kStable = 1000;
+  const int kThreads = 4;
+  const int kPerThread = 20000;
+  for (int i = 0; i < kStable; ++i) {
+    ht.Insert(i, i);
+  }
+
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    while (!done.load()) {
+      std::vector<int> visits(kStable, 0);
+      ht.ForEach([&](int key, int) {
+        if (key < kStable) {
+          ++visits[key];
+        }
+      });
+      for (int i = 0; i < kStable; ++i) {
+        int value;
+        ASSERT_EQ(visits[i], 1);
+        ASSERT_TRUE(ht.Lookup(i, value));
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kThreads; ++t) {
+    writers.emplace_back([&, t] {
+      int begin = kStable + t * kPerThread;
+      for (int i = begin; i < begin + kPerThread; ++i) {
+        ASSERT_TRUE(ht.Insert(i, i));
+      }
+      for (int i = begin; i < begin + kPerThread; ++i) {
+        ASSERT_TRUE(ht.Remove(i));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  ASSERT_EQ(ht.Size(), kStable);
+  for (int i = 0; i < kStable + kThreads * kPerThread; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i < kStable);
+  }
+}
+
+template<typename Backend>
+void CheckBulkConstruction(ResizeMode resize_mode) {
+  HashTableOptions options;
+  options.resize_mode = resize_mode;
+  std::vector<std::pair<int, std::string>> pairs;
+  for (int i = 0; i < 10000; ++i) {
+    pairs.emplace_back(i, std::to_string(i));
+  }
+  // Of equal keys the first pair wins.
+  auto duplicates = pairs;
+  for (int i = 0; i < 10000; i += 3) {
+    duplicates.emplace_back(i, "duplicate");
+  }
+  HashTable<int, std::string, Backend> ht(duplicates.begin(),
+                                          duplicates.end(), 1, options);
+  ASSERT_EQ(ht.Size(), pairs.size());
+  for (const auto& [key, value] : pairs) {
+    std::string found;
+    ASSERT_TRUE(ht.Lookup(key, found));
+    ASSERT_EQ(found, value);
+  }
+  ASSERT_FALSE(ht.Insert(0, "x"));
+  ASSERT_TRUE(ht.Remove(0));
+  ASSERT_TRUE(ht.Insert(0, "0"));
+
+  ht.Reserve(100000);
+  ht.Reserve(10);
+  ASSERT_EQ(ht.Size(), pairs.size());
+  for (const auto& [key, value] : pairs) {
+    std::string found;
+    ASSERT_TRUE(ht.Lookup(key, found));
+    ASSERT_EQ(found, value);
+  }
+
+  HashTable<int, std::string, Backend> empty(pairs.end(), pairs.end());
+  ASSERT_EQ(empty.Size(), 0);
+}
+
+TYPED_TEST(HashTableBackendTest, BulkConstructionAndReserve) {
+  for (auto resize_mode : {ResizeMode::kStopTheWorld, ResizeMode::kIncremental,
+                           ResizeMode::kBackground}) {
+    CheckBulkConstruction<TypeParam>(resize_mode);
+  }
+}
+
+// Writes strings with their lengths in front.
+struct StringSerializer {
+  void Save(const std::string& key, const std::string& value,
+            std::string& record) const {
+    for (const auto* part : {&key, &value}) {
+      auto size = static_cast<uint32_t>(part->size());
+      record.append(reinterpret_cast<const char*>(&size), sizeof(size));
+      record += *part;
+    }
+  }
+
+  size_t Load(const char* data, size_t size, std::string& key,
+              std::string& value) const {
+    size_t offset = 0;
+    for (auto* part : {&key, &value}) {
+      uint32_t part_size;
+      if (size - offset < sizeof(part_size)) {
+        return 0;
+      }
+      std::memcpy(&part_size, data + offset, sizeof(part_size));
+      offset += sizeof(part_size);
+      if (size - offset < part_size) {
+        return 0;
+      }
+      part->assign(data + offset, part_size);
+      offset += part_size;
+    }
+    return offset;
+  }
+};
+
+// Loads every key modulo 10.
+struct ModuloSerializer : TrivialSerializer<int, int> {
+  size_t Load(const char* data, size_t size, int& key, int& value) const {
+    auto record_size = TrivialSerializer::Load(data, size, key, value);
+    key %= 10;
+    return record_size;
+  }
+};
+
+TYPED_TEST(HashTableBackendTest, Snapshot) {
+  using Backend = TypeParam;
+  using Table = HashTable<int, int, Backend>;
+  auto path = testing::TempDir() + "hash_table_snapshot";
+  const int kRange = 10000;
+  Table ht(1);
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, -i));
+  }
+  ASSERT_TRUE(ht.SaveSnapshot(path));
+  auto loaded = Table::LoadSnapshot(path);
+  ASSERT_NE(loaded, nullptr);
+  ASSERT_EQ(loaded->Size(), kRange);
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(loaded->Lookup(i, value));
+    ASSERT_EQ(value, -i);
+  }
+  ASSERT_TRUE(loaded->Insert(kRange, 0));
+  ASSERT_TRUE(loaded->Remove(0));
+
+  ASSERT_EQ((HashTable<int64_t, int, Backend>::LoadSnapshot(path)), nullptr);
+  auto duplicates = Table::LoadSnapshot(path, ModuloSerializer());
+  ASSERT_NE(duplicates, nullptr);
+  ASSERT_EQ(duplicates->Size(), 10);
+
+  // Stable keys survive a save under writers.
+  std::atomic<bool> done = false;
+  std::thread writer([&] {
+    for (int i = 2 * kRange; !done.load(); ++i) {
+      ht.Insert(i, i);
+      ht.Remove(i - 100);
+    }
+  });
+  for (int round = 0; round < 5; ++round) {
+    ASSERT_TRUE(ht.SaveSnapshot(path));
+    loaded = Table::LoadSnapshot(path);
+    ASSERT_NE(loaded, nullptr);
+    for (int i = 0; i < kRange; ++i) {
+      int value;
+      ASSERT_TRUE(loaded->Lookup(i, value));
+      ASSERT_EQ(value, -i);
+    }
+  }
+  done.store(true);
+  writer.join();
+
+  using StringTable = HashTable<std::string, std::string, Backend>;
+  StringTable strings(1);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(strings.Insert(std::to_string(i), std::string(i % 50, 'x')));
+  }
+  ASSERT_TRUE(strings.SaveSnapshot(path, StringSerializer()));
+  auto loaded_strings = StringTable::LoadSnapshot(path, StringSerializer());
+  ASSERT_NE(loaded_strings, nullptr);
+  ASSERT_EQ(loaded_strings->Size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    std::string value;
+    ASSERT_TRUE(loaded_strings->Lookup(std::to_string(i), value));
+    ASSERT_EQ(value, std::string(i % 50, 'x'));
+  }
+
+  // A count too large to reserve for is rejected before it is used.
+  ASSERT_TRUE(ht.SaveSnapshot(path));
+  auto* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(std::fseek(file, offsetof(hash_table_internals::SnapshotHeader,
+                                      record_count) + 7, SEEK_SET), 0);
+  std::fputc(0x7f, file);
+  std::fclose(file);
+  ASSERT_EQ(Table::LoadSnapshot(path), nullptr);
+
+  std::remove(path.c_str());
+  ASSERT_EQ(Table::LoadSnapshot(path), nullptr);
+}
+
+// Grows the table from another thread while the first record is saved.
+struct GrowingSerializer : TrivialSerializer<int, int> {
+  void Save(int key, int value, std::string& record) const {
+    if (!*grown) {
+      *grown = true;
+      std::thread([this] {
+        for (int i = 1000; i < 2000; ++i) {
+          table->Insert(i, i);
+        }
+      }).join();
+    }
+    TrivialSerializer::Save(key, value, record);
+  }
+
+  HashTable<int, int>* table;
+  bool* grown;
+};
+
+TEST(HashTable, SaveSnapshotDefersResizes) {
+  auto path = testing::TempDir() + "hash_table_deferred_resize";
+  std::atomic<int> resize_count = 0;
+  HashTableOptions options;
+  options.on_resize_start = [&](size_t, size_t) { ++resize_count; };
+  HashTable<int, int> ht(16, options);
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  bool grown = false;
+  ASSERT_TRUE(ht.SaveSnapshot(path, GrowingSerializer{{}, &ht, &grown}));
+  ASSERT_TRUE(grown);
+  ASSERT_EQ(resize_count.load(), 0);
+
+  // The growth that the save held back is requested again.
+  ASSERT_TRUE(ht.Insert(-1, -1));
+  ASSERT_GT(resize_count.load(), 0);
+
+  auto loaded = HashTable<int, int>::LoadSnapshot(path);
+  ASSERT_NE(loaded, nullptr);
+  for (int i = 0; i < 8; ++i) {
+    int value;
+    ASSERT_TRUE(loaded->Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+  std::remove(path.c_str());
+}
+
+template<typename Backend, typename StatsPolicy>
+void CheckStats() {
+  using Table = HashTable<int, int, Backend,
+                          PoolAllocator<std::pair<const int, int>>,
+                          RCUReclamation, std::hash<int>, std::equal_to<int>,
+                          PowerOfTwoGrowth, StatsPolicy>;
+  const bool kCollected = std::is_same_v<StatsPolicy, CollectStats>;
+  std::vector<std::pair<size_t, size_t>> starts;
+  std::vector<std::pair<size_t, size_t>> finishes;
+  HashTableOptions options;
+  options.on_resize_start = [&](size_t old_count, size_t new_count) {
+    starts.emplace_back(old_count, new_count);
+  };
+  options.on_resize_finish = [&](size_t old_count, size_t new_count,
+                                 std::chrono::nanoseconds duration) {
+    ASSERT_GT(duration.count(), 0);
+    finishes.emplace_back(old_count, new_count);
+  };
+  Table ht(1, options);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  ASSERT_FALSE(ht.Insert(0, 0));
+  ht.InsertOrAssign(0, 1);
+  for (int i = 0; i < 1000; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+  }
+  std::array<int, 4> keys = {1, 2, 3, 4};
+  std::array<int, 4> values;
+  bool found[4];
+  ht.MultiLookup(keys.data(), keys.size(), values.data(), found);
+  for (int i = 0; i < 500; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+
+  auto stats = ht.Stats();
+  ASSERT_EQ(stats.lookup_count, kCollected ? 1004 : 0);
+  ASSERT_EQ(stats.insert_count, kCollected ? 1001 : 0);
+  ASSERT_EQ(stats.update_count, kCollected ? 1 : 0);
+  ASSERT_EQ(stats.remove_count, kCollected ? 500 : 0);
+  ASSERT_EQ(stats.lock_wait_count, 0);
+  ASSERT_EQ(stats.size, 500);
+  ASSERT_GE(stats.bucket_count, 500);
+  ASSERT_DOUBLE_EQ(stats.load_factor, 500.0 / stats.bucket_count);
+  size_t counted = 0;
+  size_t elements = 0;
+  for (size_t i = 0; i < stats.chain_lengths.size(); ++i) {
+    counted += stats.chain_lengths[i];
+    elements += i * stats.chain_lengths[i];
+  }
+  if (std::is_same_v<Backend, OpenAddressingBackend>) {
+    ASSERT_EQ(counted, 500);
+    ASSERT_EQ(stats.chain_lengths[0], 0);
+  } else {
+    ASSERT_EQ(counted, stats.bucket_count);
+    ASSERT_EQ(elements, 500);
+  }
+
+  ASSERT_GT(stats.resize_count, 0);
+  ASSERT_EQ(starts.size(), stats.resize_count);
+  ASSERT_EQ(finishes, starts);
+  ASSERT_EQ(finishes.back().second, stats.bucket_count);
+  ASSERT_GE(stats.resize_time, stats.max_resize_time);
+  ASSERT_GT(stats.max_resize_time.count(), 0);
+  if (kCollected) {
+    ASSERT_GE(stats.synchronize_count, stats.resize_count);
+    ASSERT_GT(stats.synchronize_time.count(), 0);
+  } else {
+    ASSERT_EQ(stats.synchronize_count, 0);
+  }
+}
+
+TYPED_TEST(HashTableBackendTest, Stats) {
+  CheckStats<TypeParam, CollectStats>();
+  CheckStats<TypeParam, NoStats>();
+}
+
+TEST(HashTable, StatsUnderContention) {
+  HashTable<int, int, ChainingBackend,
+            PoolAllocator<std::pair<const int, int>>, EpochReclamation,
+            std::hash<int>, std::equal_to<int>, PowerOfTwoGrowth,
+            CollectStats> ht(1);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 10000; ++i) {
+        ht.Insert(i % 100, i);
+        ht.Remove(i % 100);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto stats = ht.Stats();
+  ASSERT_EQ(stats.insert_count, 40000);
+  ASSERT_EQ(stats.remove_count, 40000);
+  ASSERT_EQ(stats.size, 0);
+  ASSERT_LE(stats.pending_reclamation_count, 40000);
+  if (stats.lock_wait_count > 0) {
+    ASSERT_GT(stats.lock_wait_time.count(), 0);
+  }
+
+  HashTable<int, int, ChainingBackend,
+            PoolAllocator<std::pair<const int, int>>,
+            HazardPointerReclamation> hazard_pointer_table(1);
+  ASSERT_TRUE(hazard_pointer_table.Insert(1, 1));
+  auto hazard_pointer_stats = hazard_pointer_table.Stats();
+  ASSERT_EQ(hazard_pointer_stats.size, 1);
+  for (auto count : hazard_pointer_stats.chain_lengths) {
+    ASSERT_EQ(count, 0);
+  }
+}
+
+TEST(HashTable, StatsCountReclamationGracePeriods) {
+  HashTable<int, int, ChainingBackend,
+            PoolAllocator<std::pair<const int, int>>, RCUReclamation,
+            std::hash<int>, std::equal_to<int>, PowerOfTwoGrowth,
+            CollectStats> ht(1 << 12);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  // Handed over batches are freed by the reclaimer after a grace period.
+  auto stats = ht.Stats();
+  while (stats.pending_reclamation_count > 0) {
+    std::this_thread::yield();
+    stats = ht.Stats();
+  }
+  // A resize waits for two grace periods.
+  ASSERT_GT(stats.synchronize_count, 2 * stats.resize_count);
+  ASSERT_GT(stats.synchronize_time.count(), 0);
+}
+
+TEST(HashTable, ManyRemovesWithSlowReader) {
+  HashTable<int, int> ht(1);
+
+  const int kRange = 100000;
+
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    while (!done.load()) {
+      int value;
+      ht.Lookup(0, value);
+      std::this_thread::yield();
+    }
+  });
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  done = true;
+  reader.join();
+  ASSERT_EQ(ht.Size(), 0);
+}
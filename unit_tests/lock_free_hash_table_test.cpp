@@ -0,0 +1,177 @@
+#include "hash_table.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+template<typename Key, typename Value>
+using LockFreeHashTable = HashTable<Key, Value, LockFreeChainingBackend>;
+
+TEST(LockFreeHashTable, API) {
+  LockFreeHashTable<std::string, std::string> ht(1);
+
+  std::string value;
+  ASSERT_FALSE(ht.Lookup("key", value));
+  ASSERT_TRUE(ht.Insert("key", "value"));
+  ASSERT_FALSE(ht.Insert("key", "other"));
+  ASSERT_TRUE(ht.Lookup("key", value));
+  ASSERT_EQ(value, "value");
+  ASSERT_TRUE(ht.Remove("key"));
+  ASSERT_FALSE(ht.Remove("key"));
+  ASSERT_FALSE(ht.Lookup("key", value));
+}
+
+TEST(LockFreeHashTable, Growth) {
+  LockFreeHashTable<int, int> ht(1);
+
+  const int kRange = 10000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  ASSERT_EQ(ht.Size(), kRange);
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i % 2 == 1);
+  }
+}
+
+TEST(LockFreeHashTable, Clear) {
+  LockFreeHashTable<int, std::string> ht(16);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(ht.Insert(i, std::to_string(i)));
+  }
+  ht.Clear();
+  ASSERT_EQ(ht.Size(), 0);
+
+  for (int i = 0; i < 100; ++i) {
+    std::string value;
+    ASSERT_FALSE(ht.Lookup(i, value));
+    ASSERT_TRUE(ht.Insert(i, std::to_string(-i)));
+  }
+}
+
+// A single bucket that is never resized, so every writer races on one chain:
+// each key must be inserted and removed by exactly one of them.
+TEST(LockFreeHashTable, WritersOfOneBucket) {
+  HashTableOptions options;
+  options.max_load_factor = 1e9;
+  options.min_load_factor = 0;
+  LockFreeHashTable<int, int> ht(1, options);
+
+  const int kThreads = 8;
+  const int kRange = 200;
+  const int kRounds = 50;
+
+  std::atomic<int> inserted = 0;
+  std::atomic<int> removed = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      for (int round = 0; round < kRounds; ++round) {
+        for (int i = 0; i < kRange; ++i) {
+          inserted += ht.Insert(i, i);
+        }
+        for (int i = 0; i < kRange; ++i) {
+          removed += ht.Remove(i);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(inserted.load(), removed.load());
+  ASSERT_EQ(ht.Size(), 0);
+}
+
+namespace {
+
+// Puts every key in one chain, whatever the bucket count.
+struct ConstantHash {
+  size_t operator()(int /*key*/) const { return 0; }
+};
+
+}  // namespace
+
+// Every thread churns keys of its own at the head of one long chain, and in
+// each round all threads race to insert a shared key that is never removed.
+// Removed nodes are recycled by the pool as soon as no hazard pointer holds
+// them, so an insert whose expected head was freed and reused meanwhile would
+// link the shared key twice.
+TEST(LockFreeHashTable, HazardPointerChurnOfOneChain) {
+  HashTable<int, int, LockFreeChainingBackend,
+            PoolAllocator<std::pair<const int, int>>,
+            HazardPointerReclamation, ConstantHash> ht(1);
+
+  const int kThreads = 4;
+  const int kKeysPerThread = 4;
+  const int kRounds = 1000;
+
+  std::atomic<int> inserted = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int round = 0; round < kRounds; ++round) {
+        for (int i = 0; i < kKeysPerThread; ++i) {
+          ASSERT_TRUE(ht.Insert(t * kKeysPerThread + i, round));
+        }
+        inserted += ht.Insert(-1 - round, t);
+        for (int i = 0; i < kKeysPerThread; ++i) {
+          ASSERT_TRUE(ht.Remove(t * kKeysPerThread + i));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(inserted.load(), kRounds);
+  for (int round = 0; round < kRounds; ++round) {
+    int removed = 0;
+    while (ht.Remove(-1 - round)) {
+      ++removed;
+    }
+    ASSERT_EQ(removed, 1);
+  }
+  ASSERT_EQ(ht.Size(), 0);
+}
+
+// All threads insert the same keys while the table grows, so some of them
+// run into buckets that are being moved.
+TEST(LockFreeHashTable, WritersDuringResizes) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  LockFreeHashTable<int, int> ht(1, options);
+
+  const int kThreads = 4;
+  const int kRange = 5000;
+
+  std::atomic<int> inserted = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < kRange; ++i) {
+        inserted += ht.Insert(i, i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(inserted.load(), kRange);
+  ASSERT_EQ(ht.Size(), kRange);
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+}
@@ -41,6 +41,47 @@ TEST(RCULock, SynchronizeWithReaders) {
   ASSERT_EQ(readers_completed.load(), kReaders);
 }
 
+TEST(RCULock, ConcurrentSynchronize) {
+  const size_t kReaders = 4;
+  const size_t kWriters = 4;
+  const size_t kIterations = 1000;
+
+  RCULock rcu_lock;
+  std::atomic<int*> data{new int(0)};
+  std::atomic<bool> stopped{false};
+
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < kReaders; ++i) {
+    readers.emplace_back([&] {
+      while (!stopped.load()) {
+        std::unique_lock<RCULock> lock(rcu_lock);
+        ASSERT_GE(*data.load(), 0);
+      }
+    });
+  }
+
+  // Every writer frees what it replaced, so a grace period shared by several
+  // writers must still cover the readers of each of them.
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < kWriters; ++i) {
+    writers.emplace_back([&] {
+      for (size_t j = 0; j < kIterations; ++j) {
+        auto* old_data = data.exchange(new int(j));
+        rcu_lock.Synchronize();
+        delete old_data;
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  stopped = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  delete data.load();
+}
+
 //struct Data {
 //  std::atomic<size_t> value = 0;
 //  RCULock lock;
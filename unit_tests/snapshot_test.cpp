@@ -0,0 +1,113 @@
+#include "snapshot.h"
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using hash_table_internals::SnapshotChecksum;
+using hash_table_internals::SnapshotHeader;
+using hash_table_internals::SnapshotReader;
+using hash_table_internals::SnapshotWriter;
+
+namespace {
+
+std::string WriteSnapshot(const std::string& name,
+                          const std::vector<std::string>& records) {
+  auto path = testing::TempDir() + name;
+  SnapshotWriter writer(path, 4, 8);
+  for (const auto& record : records) {
+    writer.Record() += record;
+    writer.EndRecord();
+  }
+  EXPECT_TRUE(writer.Finish());
+  return path;
+}
+
+void FlipByte(const std::string& path, long offset) {
+  auto* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(std::fseek(file, offset, SEEK_SET), 0);
+  int byte = std::fgetc(file);
+  ASSERT_EQ(std::fseek(file, offset, SEEK_SET), 0);
+  std::fputc(byte ^ 1, file);
+  std::fclose(file);
+}
+
+}  // namespace
+
+TEST(SnapshotChecksum, IndependentOfPieces) {
+  std::string data;
+  for (int i = 0; i < 100; ++i) {
+    data += static_cast<char>(i * 7);
+  }
+  SnapshotChecksum whole;
+  whole.Update(data.data(), data.size());
+  SnapshotChecksum pieces;
+  for (size_t begin = 0, size = 1; begin < data.size(); begin += size++) {
+    pieces.Update(data.data() + begin, std::min(size, data.size() - begin));
+  }
+  ASSERT_EQ(whole.Value(), pieces.Value());
+
+  data[50] ^= 1;
+  SnapshotChecksum corrupted;
+  corrupted.Update(data.data(), data.size());
+  ASSERT_NE(whole.Value(), corrupted.Value());
+}
+
+TEST(Snapshot, RoundTrip) {
+  auto path = WriteSnapshot("round_trip", {"abc", "", "defgh"});
+  SnapshotReader reader(path, 4, 8);
+  ASSERT_TRUE(reader.IsValid());
+  ASSERT_EQ(reader.RecordCount(), 3);
+  ASSERT_EQ(std::string(reader.Records(), reader.RecordsSize()), "abcdefgh");
+  std::remove(path.c_str());
+}
+
+TEST(Snapshot, RejectsInvalidFiles) {
+  auto path = WriteSnapshot("invalid", {"abc", "defgh"});
+  ASSERT_FALSE(SnapshotReader(path, 8, 8).IsValid());
+  ASSERT_FALSE(SnapshotReader(path, 4, 4).IsValid());
+  FlipByte(path, sizeof(SnapshotHeader) + 2);
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  FlipByte(path, sizeof(SnapshotHeader) + 2);
+  ASSERT_TRUE(SnapshotReader(path, 4, 8).IsValid());
+  FlipByte(path, 0);
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  std::remove(path.c_str());
+
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  auto* file = std::fopen(path.c_str(), "wb");
+  std::fputs("short", file);
+  std::fclose(file);
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  std::remove(path.c_str());
+}
+
+TEST(Snapshot, RejectsCorruptedHeader) {
+  auto path = WriteSnapshot("corrupted_header", {"abc", "defgh"});
+  auto count_offset = offsetof(SnapshotHeader, record_count);
+  FlipByte(path, count_offset);
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  FlipByte(path, count_offset);
+  ASSERT_TRUE(SnapshotReader(path, 4, 8).IsValid());
+  FlipByte(path, count_offset + sizeof(uint64_t) - 1);
+  ASSERT_FALSE(SnapshotReader(path, 4, 8).IsValid());
+  std::remove(path.c_str());
+}
+
+TEST(Snapshot, FailedSaveKeepsPreviousFile) {
+  auto path = WriteSnapshot("kept", {"abc"});
+  {
+    SnapshotWriter writer(path, 4, 8);
+    writer.Record() += "xyz";
+    writer.EndRecord();
+  }
+  SnapshotReader reader(path, 4, 8);
+  ASSERT_TRUE(reader.IsValid());
+  ASSERT_EQ(std::string(reader.Records(), reader.RecordsSize()), "abc");
+  std::remove(path.c_str());
+
+  SnapshotWriter writer(testing::TempDir() + "missing/dir", 4, 8);
+  ASSERT_FALSE(writer.Finish());
+}
@@ -80,10 +80,17 @@ TEST(ThreadLocal, IterateThreadLocalValues) {
 TEST(ThreadLocal, IterateThreadLocalCounters) {
   static const size_t kThreads = 10;
   ThreadLocal<size_t> tl;
+  std::atomic<size_t> passed_threads{0};
 
-  auto accessor = [&tl]() {
+  // The threads stay alive together, so none of them is given the slot of
+  // another.
+  auto accessor = [&tl, &passed_threads]() {
     ++(*tl);
     ASSERT_EQ(*tl, 1);
+    passed_threads.fetch_add(1);
+    while (passed_threads.load() < kThreads) {
+      std::this_thread::yield();
+    }
   };
 
   std::vector<std::thread> threads;
@@ -100,3 +107,42 @@ TEST(ThreadLocal, IterateThreadLocalCounters) {
   }
   ASSERT_EQ(total, kThreads);
 }
+
+TEST(ThreadLocal, SlotsOfExitedThreadsAreReused) {
+  static const size_t kThreads = 1000;
+  InheritingThreadLocal<size_t> tl;
+
+  for (size_t i = 0; i < kThreads; i++) {
+    std::thread([&tl] { ++(*tl); }).join();
+  }
+
+  size_t slot_count = 0;
+  size_t total = 0;
+  for (auto value : tl) {
+    ++slot_count;
+    total += value;
+  }
+  ASSERT_LT(slot_count, 10);
+  ASSERT_EQ(total, kThreads);
+}
+
+TEST(ThreadLocal, ValuesOfReusedSlotsAreReset) {
+  static const size_t kThreads = 1000;
+  ThreadLocal<size_t> tl;
+
+  for (size_t i = 0; i < kThreads; i++) {
+    std::thread([&tl] {
+      ++(*tl);
+      ASSERT_EQ(*tl, 1);
+    }).join();
+  }
+
+  size_t slot_count = 0;
+  size_t total = 0;
+  for (auto value : tl) {
+    ++slot_count;
+    total += value;
+  }
+  ASSERT_LT(slot_count, 10);
+  ASSERT_EQ(total, slot_count);
+}
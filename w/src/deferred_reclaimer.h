@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rcu_lock.h"
+#include "thread_local.h"
+
+namespace hash_table_internals {
+
+// An object that is freed by `reclaim(context, object)` once no reader can
+// reach it.
+struct RetiredObject {
+  using ReclaimFunction = void (*)(void* context, void* object);
+
+  void Reclaim() const { reclaim(context, object); }
+
+  void* object;
+  ReclaimFunction reclaim;
+  void* context;
+};
+
+// Frees retired objects after a grace period of `lock`, in the manner of
+// call_rcu. Retired objects are buffered per thread and handed over in
+// batches to a thread of the reclaimer, which waits for one grace period per
+// batch, so writers never wait for readers.
+class DeferredReclaimer {
+ public:
+  explicit DeferredReclaimer(RCULock& lock) : lock_(lock) {}
+
+  // There must be no readers left.
+  ~DeferredReclaimer() {
+    if (worker_thread_.joinable()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopped_ = true;
+      }
+      pending_condition_.notify_one();
+      worker_thread_.join();
+    }
+    for (auto& buffer : buffers_) {
+      ReclaimAll(buffer);
+    }
+    ReclaimAll(pending_);
+  }
+
+  // May be called inside a read-side critical section.
+  void Retire(const RetiredObject& retired) {
+    auto& buffer = *buffers_;
+    buffer.push_back(retired);
+    if (buffer.size() < kBatchSize) {
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_.insert(pending_.end(), buffer.begin(), buffer.end());
+      backlog_.fetch_add(buffer.size());
+      if (!worker_thread_.joinable()) {
+        worker_thread_ = std::thread([this] { WorkerRoutine(); });
+      }
+    }
+    buffer.clear();
+    pending_condition_.notify_one();
+  }
+
+  // Blocks while too many handed over objects wait for their grace period.
+  // Must be called outside read-side critical sections, which the reclaimer
+  // waits for.
+  void Throttle() {
+    if (backlog_.load(std::memory_order_relaxed) < kMaxBacklog) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_condition_.wait(lock, [this] {
+      return backlog_.load() < kMaxBacklog;
+    });
+  }
+
+ private:
+  static constexpr size_t kBatchSize = 64;
+  static constexpr size_t kMaxBacklog = 1 << 16;
+
+  static void ReclaimAll(std::vector<RetiredObject>& retired) {
+    for (auto& element : retired) {
+      element.Reclaim();
+    }
+    retired.clear();
+  }
+
+  void WorkerRoutine() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      pending_condition_.wait(lock, [this] {
+        return stopped_ || !pending_.empty();
+      });
+      // The destructor reclaims what is left.
+      if (stopped_) {
+        return;
+      }
+      std::vector<RetiredObject> batch;
+      batch.swap(pending_);
+      lock.unlock();
+      // Everything handed over so far is already unreachable, so one grace
+      // period covers the whole batch.
+      lock_.Synchronize();
+      auto reclaimed_count = batch.size();
+      ReclaimAll(batch);
+      lock.lock();
+      backlog_.fetch_sub(reclaimed_count);
+      drained_condition_.notify_all();
+    }
+  }
+
+ private:
+  RCULock& lock_;
+  // Objects retired by a thread that are not handed over yet.
+  ThreadLocal<std::vector<RetiredObject>> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable pending_condition_;
+  std::condition_variable drained_condition_;
+  // Guarded by mutex_.
+  std::vector<RetiredObject> pending_;
+  bool stopped_ = false;
+  // Handed over objects that are not reclaimed yet.
+  std::atomic<size_t> backlog_ = 0;
+  std::thread worker_thread_;
+};
+
+}  // namespace hash_table_internals
@@ -0,0 +1,673 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "open_addressing_hash_table.h"
+#include "pool_allocator.h"
+#include "rcu_lock.h"
+#include "reclamation.h"
+#include "sharded_counter.h"
+#include "thread_local.h"
+
+enum class ResizeMode {
+  // The writer that triggers a resize moves every bucket to the new table.
+  kStopTheWorld,
+  // Every Insert/Remove moves a bounded number of buckets, so the cost of a
+  // resize is spread over all writers.
+  kIncremental,
+  // A dedicated thread owned by the table performs every resize, so Insert and
+  // Remove never pay for it.
+  kBackground,
+};
+
+struct HashTableOptions {
+  ResizeMode resize_mode = ResizeMode::kStopTheWorld;
+  // How many buckets a single Insert/Remove constructs or moves to the new
+  // table in the incremental mode. The background resizer checks for shutdown
+  // after each such step.
+  size_t incremental_resize_step = 16;
+  // An Insert that makes the average number of elements per bucket exceed
+  // max_load_factor doubles the table.
+  double max_load_factor = 1;
+  // A Remove that leaves fewer than min_load_factor elements per bucket halves
+  // the table, but never below the initial bucket count. Zero disables
+  // shrinking. Has to stay below a quarter of max_load_factor, so that a table
+  // that has just been resized is not immediately resized back.
+  double min_load_factor = 0.125;
+};
+
+namespace hash_table_internals {
+
+template<typename Key, typename Value, typename Allocator, typename Table>
+class HashTableImpl {
+ private:
+  class Bucket {
+    friend class HashTableImpl;
+
+   public:
+    struct Node {
+      Node(size_t hash, const Key& key, const Value& value)
+          : hash(hash), key(key), value(value) {}
+
+      // Cached so that moving the node to a new table does not rehash the key,
+      // and chain scans compare keys only when the hashes match.
+      size_t hash = 0;
+      std::array<std::atomic<Node*>, 2> next{nullptr, nullptr};
+      Key key;
+      Value value;
+
+      bool Matches(const Key& other_key, size_t other_hash) const {
+        return hash == other_hash && key == other_key;
+      }
+    };
+
+    using NodeAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+   public:
+    ~Bucket() {
+      auto head = head_.load();
+      while (head) {
+        auto next = head->next[index_to_cleanup_].load();
+        DeleteNode(head);
+        head = next;
+      }
+    }
+
+    bool Insert(const Key& key, size_t hash, const Value& value,
+                size_t index) {
+      if (Find(key, hash, index)) {
+        return false;
+      }
+      auto* new_node = NodeTraits::allocate(*node_allocator_, 1);
+      NodeTraits::construct(*node_allocator_, new_node, hash, key, value);
+      LinkNode(new_node, index);
+      return true;
+    }
+
+    void LinkNode(Node* new_node, size_t index) {
+      new_node->next[index].store(head_.load());
+      head_.store(new_node);
+    }
+
+    // Returns the unlinked node, which readers may still see until a grace
+    // period ends.
+    Node* Remove(const Key& key, size_t hash, size_t index) {
+      auto* link = &head_;
+      while (link->load() != nullptr && !link->load()->Matches(key, hash)) {
+        link = &link->load()->next[index];
+      }
+      auto* node = link->load();
+      if (node != nullptr) {
+        link->store(node->next[index].load());
+        removal_count_.fetch_add(1);
+      }
+      return node;
+    }
+
+    // Returns the detached chain, which readers may still see until a grace
+    // period ends.
+    Node* Clear() {
+      auto* head = head_.exchange(nullptr);
+      removal_count_.fetch_add(1);
+      return head;
+    }
+
+    // Nodes are loaded through `guard`. If it only protects the nodes
+    // themselves, the successor of a removed node may be freed while a reader
+    // still stands on it, so the scan restarts once the bucket loses a node.
+    template<typename Guard>
+    bool Lookup(const Key& key, size_t hash, Value& value, int index,
+                Guard& guard) {
+      while (true) {
+        auto removal_count = removal_count_.load();
+        auto* node = guard.Protect(0, head_);
+        for (size_t hazard = 1; node != nullptr; hazard ^= 1) {
+          if (Guard::kValidates && removal_count_.load() != removal_count) {
+            break;
+          }
+          if (node->Matches(key, hash)) {
+            value = node->value;
+            return true;
+          }
+          node = guard.Protect(hazard, node->next[index]);
+        }
+        if (node == nullptr) {
+          return false;
+        }
+      }
+    }
+
+   private:
+    bool Find(const Key& key, size_t hash, size_t index) {
+      auto head = head_.load();
+      bool found = false;
+      while (head != nullptr) {
+        if (head->Matches(key, hash)) {
+          found = true;
+          break;
+        }
+        head = head->next[index];
+      }
+      return found;
+    }
+
+    void DeleteNode(Node* node) {
+      NodeTraits::destroy(*node_allocator_, node);
+      NodeTraits::deallocate(*node_allocator_, node, 1);
+    }
+
+   private:
+    // The chain of the table the bucket belongs to, linked through
+    // next[index] of that table.
+    std::atomic<Node*> head_ = nullptr;
+    size_t index_to_cleanup_ = std::numeric_limits<size_t>::max();
+    NodeAllocator* node_allocator_ = nullptr;
+    std::mutex mutex_;
+    // Incremented whenever nodes leave the chain, see Lookup.
+    std::atomic<uint64_t> removal_count_ = 0;
+  };
+
+ public:
+  explicit HashTableImpl(size_t bucket_count, Table* hash_table,
+                         const Allocator& allocator,
+                         size_t current_index = 0,
+                         bool construct_buckets = true)
+      : master_hash_table_(hash_table),
+        node_allocator_(allocator),
+        current_index_(current_index),
+        bucket_count_(bucket_count),
+        buckets_(static_cast<Bucket*>(
+                     ::operator new(sizeof(Bucket) * bucket_count))) {
+    if (construct_buckets) {
+      ConstructBuckets(bucket_count);
+    }
+  }
+
+  ~HashTableImpl() {
+    for (size_t i = 0; i < constructed_bucket_count_; i++) {
+      buckets_[i].~Bucket();
+    }
+    ::operator delete(buckets_);
+  }
+
+  void LinkNode(typename Bucket::Node* node) {
+    auto[bucket, bucket_number] =
+    GetBucketInSpecifiedHashTable(this, node->hash);
+    std::unique_lock<std::mutex> lock(bucket->mutex_);
+    return bucket->LinkNode(node, current_index_);
+  }
+
+  bool Insert(const Key& key, const Value& value) {
+    auto hash = hasher_(key);
+    UpdateModeOn(hash);
+    auto[bucket, index] = GetBucket(this, hash);
+    auto result = bucket->Insert(key, hash, value, index);
+    UpdateModeOff(hash);
+    return result;
+  }
+
+  bool Remove(const Key& key) {
+    auto hash = hasher_(key);
+    UpdateModeOn(hash);
+    auto[bucket, index] = GetBucket(this, hash);
+    auto* node = bucket->Remove(key, hash, index);
+    UpdateModeOff(hash);
+    if (node == nullptr) {
+      return false;
+    }
+    master_hash_table_->Retire(node);
+    return true;
+  }
+
+  // Runs entirely inside the read-side critical section of the master table:
+  // nodes that leave a chain, whether removed, cleared or left behind in the
+  // old chain of a moved bucket, are retired to it.
+  bool Lookup(const Key& key, Value& value) {
+    auto hash = hasher_(key);
+    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, hash);
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    if (bucket_number >= resize_index_.load() &&
+        bucket->Lookup(key, hash, value, current_index_, guard)) {
+      return true;
+    }
+
+    auto[new_bucket, new_index] = GetBucket(this, hash);
+    if (new_bucket != bucket) {
+      return new_bucket->Lookup(key, hash, value, new_index, guard);
+    }
+
+    return false;
+  }
+
+  size_t Clear() {
+    size_t removed_count = 0;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      auto* bucket = &buckets_[i];
+      std::unique_lock<std::mutex> lock(bucket->mutex_);
+      auto* node = bucket->Clear();
+      while (node != nullptr) {
+        // Read before the node is retired, which may free it right away.
+        auto* next = node->next[current_index_].load();
+        master_hash_table_->Retire(node);
+        node = next;
+        ++removed_count;
+      }
+    }
+    return removed_count;
+  }
+
+ public:
+  void UpdateModeOn(size_t hash) {
+    auto[bucket, bucket_number] = GetBucketInSpecifiedHashTable(this, hash);
+    bucket->mutex_.lock();
+    if (bucket_number > resize_index_.load()) {
+      return;
+    }
+    auto[new_bucket, new_index] =
+    GetBucketInSpecifiedHashTable(new_table_.load(), hash);
+    new_bucket->mutex_.lock();
+    bucket->mutex_.unlock();
+  }
+
+  void UpdateModeOff(size_t hash) {
+    auto[bucket, index] = GetBucket(this, hash);
+    bucket->mutex_.unlock();
+  }
+
+  size_t BucketCount() const { return bucket_count_; }
+
+  bool NeedsRehash() { return false; }
+
+  // Constructs at most `max_bucket_count` more buckets. Returns true once every
+  // bucket is constructed.
+  bool ConstructBuckets(size_t max_bucket_count) {
+    auto end = constructed_bucket_count_ +
+        std::min(max_bucket_count, bucket_count_ - constructed_bucket_count_);
+    for (; constructed_bucket_count_ < end; constructed_bucket_count_++) {
+      auto* bucket = new (&buckets_[constructed_bucket_count_]) Bucket();
+      bucket->index_to_cleanup_ = current_index_;
+      bucket->node_allocator_ = &node_allocator_;
+    }
+    return constructed_bucket_count_ == bucket_count_;
+  }
+
+  static std::pair<Bucket*, int32_t> GetBucketInSpecifiedHashTable(
+      HashTableImpl* hash_table, size_t hash) {
+    auto bucket_number = hash % hash_table->bucket_count_;
+    return {&hash_table->buckets_[bucket_number], bucket_number};
+  }
+
+  static std::pair<Bucket*, int32_t> GetBucket(HashTableImpl* hash_table,
+                                               size_t hash) {
+    auto[bucket, bucket_number] =
+      GetBucketInSpecifiedHashTable(hash_table, hash);
+    auto index = hash_table->current_index_;
+    if (bucket_number <= hash_table->resize_index_.load()) {
+      HashTableImpl* new_table = hash_table->new_table_.load();
+      auto[new_bucket, new_bucket_number] =
+        GetBucketInSpecifiedHashTable(new_table, hash);
+      bucket = new_bucket;
+      index = new_table->current_index_;
+    }
+    return {bucket, index};
+  }
+
+  // Buckets of the returned table are constructed later by ConstructBuckets,
+  // so that the allocation does not have to happen in a single operation.
+  HashTableImpl* CreateNewHashTable(size_t new_bucket_count) {
+    return new HashTableImpl(new_bucket_count, master_hash_table_,
+                             Allocator(node_allocator_), current_index_ ^ 1u,
+                             /*construct_buckets =*/ false);
+  }
+
+  bool IsReallocating() const { return new_table_.load() != nullptr; }
+
+  void StartReallocation(HashTableImpl* new_table) {
+    new_table_.store(new_table);
+    master_hash_table_->lock_.Synchronize();
+  }
+
+  // Moves at most `max_bucket_count` buckets, continuing from resize_index_.
+  // Returns true once every bucket lives in the new table.
+  bool ReallocateToNewHashTable(size_t max_bucket_count) {
+    auto* new_table = new_table_.load();
+    size_t begin = resize_index_.load() + 1;
+    auto end = begin + std::min(max_bucket_count, bucket_count_ - begin);
+    for (size_t i = begin; i < end; i++) {
+      auto* bucket = &buckets_[i];
+      std::unique_lock<std::mutex> lock(bucket->mutex_);
+      resize_index_.store(i);
+      auto* current_node = bucket->head_.load();
+      while (current_node) {
+        new_table->LinkNode(current_node);
+        current_node = current_node->next[current_index_].load();
+      }
+      // Readers still in the old chain are protected by the master table,
+      // to which nodes later removed from the new chain are retired. Readers
+      // that validate restart and find the bucket empty.
+      bucket->Clear();
+    }
+    if (end != bucket_count_) {
+      return false;
+    }
+    ++resize_index_;
+    return true;
+  }
+
+ private:
+  Table* const master_hash_table_;
+  // Copies of an allocator free each other's memory, so nodes moved to the
+  // new table are freed by its copy.
+  typename Bucket::NodeAllocator node_allocator_;
+  size_t current_index_ = 0;
+  const size_t bucket_count_;
+  size_t constructed_bucket_count_ = 0;
+  Bucket* const buckets_;
+  std::hash<Key> hasher_;
+
+ private:
+  std::atomic<HashTableImpl*> new_table_ = nullptr;
+  std::atomic<int32_t> resize_index_ = -1;
+};
+
+}  // namespace hash_table_internals
+
+// Buckets are chains of nodes that are moved to the new table one bucket at a
+// time.
+struct ChainingBackend {
+  template<typename Key, typename Value, typename Allocator, typename Table>
+  using Impl =
+      hash_table_internals::HashTableImpl<Key, Value, Allocator, Table>;
+};
+
+// Elements are placed in a flat array of slots probed 16 at a time, which
+// keeps lookups in few cache lines. A resize moves all elements at once.
+struct OpenAddressingBackend {
+  template<typename Key, typename Value, typename Allocator, typename Table>
+  using Impl = hash_table_internals::OpenAddressingHashTableImpl<
+      Key, Value, Allocator, Table>;
+};
+
+// Elements are allocated one at a time through a rebound copy of Allocator
+// and freed only after the readers that could see them have left, as decided
+// by Reclamation.
+template<typename Key, typename Value, typename Backend = ChainingBackend,
+         typename Allocator = PoolAllocator<std::pair<const Key, Value>>,
+         typename Reclamation = RCUReclamation>
+class HashTable {
+  using HashTableImpl =
+      typename Backend::template Impl<Key, Value, Allocator, HashTable>;
+  using ReclamationDomain = typename Reclamation::Domain;
+  using ReclamationGuard = typename ReclamationDomain::Guard;
+
+  friend HashTableImpl;
+
+ public:
+  using allocator_type = Allocator;
+
+  explicit HashTable(size_t bucket_count,
+                     HashTableOptions options = HashTableOptions(),
+                     const Allocator& allocator = Allocator())
+      : options_(options),
+        min_bucket_count_(bucket_count),
+        allocator_(allocator),
+        hash_table_impl_(new HashTableImpl(bucket_count, this, allocator)) {
+    assert(options_.min_load_factor * 4 <= options_.max_load_factor);
+    if (options_.resize_mode == ResizeMode::kBackground) {
+      resizer_thread_ = std::thread([this] { ResizerRoutine(); });
+    }
+  }
+
+  ~HashTable() {
+    if (resizer_thread_.joinable()) {
+      {
+        std::unique_lock<std::mutex> lock(resizer_mutex_);
+        resizer_stopped_ = true;
+      }
+      resizer_condition_.notify_one();
+      resizer_thread_.join();
+    }
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    // Chains of an unfinished resize are disjoint: moved buckets are cut from
+    // the old table, so each node is deleted exactly once.
+    delete new_hash_table_impl_;
+    delete hash_table_impl_.load();
+  }
+
+  bool Insert(const Key& key, const Value& value) {
+    // Only an open addressing table may have no room for the key.
+    std::optional<bool> result;
+    while (true) {
+      HashTableImpl* hash_table;
+      {
+        std::unique_lock<ReclamationDomain> read_lock(lock_);
+        hash_table = hash_table_impl_.load();
+        result = hash_table->Insert(key, value);
+        if (result.value_or(false) && size_.Add(1, SizeBatch())) {
+          NeedGrowth();
+        }
+      }
+      if (result.has_value()) {
+        break;
+      }
+      FinishResize(hash_table);
+    }
+    HelpResize();
+    return *result;
+  }
+
+  bool Remove(const Key& key) {
+    bool result;
+    {
+      std::unique_lock<ReclamationDomain> read_lock(lock_);
+      result = hash_table_impl_.load()->Remove(key);
+      if (result && size_.Add(-1, SizeBatch())) {
+        NeedShrink();
+      }
+    }
+    HelpResize();
+    lock_.Throttle();
+    return result;
+  }
+
+  bool Lookup(const Key& key, Value& value) {
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    return hash_table_impl_.load()->Lookup(key, value);
+  }
+
+  void Clear() {
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+    if (new_hash_table_impl_ != nullptr) {
+      ResizeStep(new_hash_table_impl_->BucketCount(),
+                 std::numeric_limits<size_t>::max());
+    }
+    std::unique_lock<ReclamationDomain> read_lock(lock_);
+    int64_t removed_count = hash_table_impl_.load()->Clear();
+    size_.Add(-removed_count, /*batch =*/ 0);
+  }
+
+  // Number of elements. Exact when no writer runs concurrently.
+  size_t Size() { return std::max<int64_t>(size_.Sum(), 0); }
+
+ private:
+  size_t BucketCount() const { return hash_table_impl_.load()->BucketCount(); }
+
+  void HelpResize() {
+    auto bucket_count = resize_bucket_count_.load();
+    if (bucket_count != -1 &&
+        options_.resize_mode != ResizeMode::kBackground) {
+      Resize(bucket_count);
+    }
+  }
+
+  void Resize(size_t bucket_count) {
+    if (!resize_mutex_.try_lock()) {
+      return;
+    }
+    auto step = options_.resize_mode == ResizeMode::kIncremental
+                ? options_.incremental_resize_step
+                : std::numeric_limits<size_t>::max();
+    ResizeStep(bucket_count, step);
+    resize_mutex_.unlock();
+  }
+
+  // Blocks until `full_hash_table` is replaced, growing it unless another
+  // resize is pending.
+  void FinishResize(HashTableImpl* full_hash_table) {
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+    if (hash_table_impl_.load() != full_hash_table) {
+      return;
+    }
+    if (new_hash_table_impl_ == nullptr) {
+      NeedResize(BucketCount() * 2 + 1);
+    }
+    auto bucket_count = resize_bucket_count_.load();
+    if (bucket_count != -1) {
+      ResizeStep(bucket_count, std::numeric_limits<size_t>::max());
+    }
+  }
+
+  // Advances the resize by at most `step` constructed and `step` moved
+  // buckets. Returns true once the resize is over. Requires resize_mutex_.
+  bool ResizeStep(size_t bucket_count, size_t step) {
+    auto* old_hash_table = hash_table_impl_.load();
+    if (new_hash_table_impl_ == nullptr) {
+      // A request for the same size only rebuilds tables that ask for it.
+      if (old_hash_table->BucketCount() == bucket_count &&
+          !old_hash_table->NeedsRehash()) {
+        resize_bucket_count_ = -1;
+        return true;
+      }
+      new_hash_table_impl_ = old_hash_table->CreateNewHashTable(bucket_count);
+    }
+    if (!new_hash_table_impl_->ConstructBuckets(step)) {
+      return false;
+    }
+    if (!old_hash_table->IsReallocating()) {
+      old_hash_table->StartReallocation(new_hash_table_impl_);
+    }
+    if (!old_hash_table->ReallocateToNewHashTable(step)) {
+      return false;
+    }
+
+    hash_table_impl_.store(new_hash_table_impl_);
+    new_hash_table_impl_ = nullptr;
+    lock_.Synchronize();
+    resize_bucket_count_ = -1;
+    delete old_hash_table;
+    ++resize_count_;
+    return true;
+  }
+
+  // Frees `object` through allocator_ once no reader can reach it.
+  template<typename T>
+  void Retire(T* object) {
+    lock_.Retire({object, &HashTable::Reclaim<T>, this});
+  }
+
+  template<typename T>
+  static void Reclaim(void* hash_table, void* object) {
+    using ObjectAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using ObjectTraits = std::allocator_traits<ObjectAllocator>;
+    ObjectAllocator allocator(static_cast<HashTable*>(hash_table)->allocator_);
+    ObjectTraits::destroy(allocator, static_cast<T*>(object));
+    ObjectTraits::deallocate(allocator, static_cast<T*>(object), 1);
+  }
+
+  // Each writer flushes its part of the element count at most every 64
+  // updates; small tables flush more often, so that they grow in time.
+  int64_t SizeBatch() const {
+    return std::clamp<int64_t>(BucketCount() / 16, 1, 64);
+  }
+
+  // NeedGrowth and NeedShrink must be called inside a read-side critical
+  // section, as they look at the current table.
+  void NeedGrowth() {
+    auto bucket_count = BucketCount();
+    if (size_.Total() > bucket_count * options_.max_load_factor) {
+      NeedResize(bucket_count * 2 + 1);
+    }
+  }
+
+  void NeedShrink() {
+    auto bucket_count = BucketCount();
+    if (bucket_count > min_bucket_count_ &&
+        size_.Total() < bucket_count * options_.min_load_factor) {
+      NeedResize(std::max(min_bucket_count_, (bucket_count - 1) / 2));
+    }
+  }
+
+  void NeedResize(size_t bucket_count) {
+    if (resize_bucket_count_.load() != -1) {
+      return;
+    }
+    int32_t expected = -1;
+    if (resize_bucket_count_.compare_exchange_strong(expected, bucket_count) &&
+        options_.resize_mode == ResizeMode::kBackground) {
+      // Taking the mutex orders the store before the resizer checks for work,
+      // so the notification cannot be lost.
+      { std::unique_lock<std::mutex> lock(resizer_mutex_); }
+      resizer_condition_.notify_one();
+    }
+  }
+
+  void ResizerRoutine() {
+    std::unique_lock<std::mutex> lock(resizer_mutex_);
+    while (true) {
+      resizer_condition_.wait(lock, [this] {
+        return resizer_stopped_ || resize_bucket_count_.load() != -1;
+      });
+      if (resizer_stopped_) {
+        return;
+      }
+      lock.unlock();
+      {
+        std::unique_lock<std::mutex> resize_lock(resize_mutex_);
+        // Clear() may have finished the resize in the meantime.
+        auto bucket_count = resize_bucket_count_.load();
+        while (bucket_count != -1 &&
+               !ResizeStep(bucket_count, options_.incremental_resize_step) &&
+               !resizer_stopped_.load()) {
+        }
+      }
+      lock.lock();
+    }
+  }
+
+ private:
+  const HashTableOptions options_;
+  const size_t min_bucket_count_;
+  const Allocator allocator_;
+  std::atomic<HashTableImpl*> hash_table_impl_;
+  // Declared after allocator_, which frees the elements still retired when
+  // the domain is destroyed.
+  ReclamationDomain lock_;
+  std::mutex resize_mutex_;
+  // The table a resize moves the elements to; guarded by resize_mutex_.
+  HashTableImpl* new_hash_table_impl_ = nullptr;
+  std::atomic<std::uint32_t> resize_count_ = 0;
+  std::atomic<int32_t> resize_bucket_count_ = -1;
+  // Removing a just inserted key may decrement before the insert increments,
+  // so the count may briefly be negative.
+  hash_table_internals::ShardedCounter size_;
+
+  // Only used in the background resize mode.
+  std::thread resizer_thread_;
+  std::mutex resizer_mutex_;
+  std::condition_variable resizer_condition_;
+  std::atomic<bool> resizer_stopped_ = false;
+};
\ No newline at end of file
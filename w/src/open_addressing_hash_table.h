@@ -0,0 +1,465 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sharded_counter.h"
+
+namespace hash_table_internals {
+
+// Open addressing table with Swiss-table style control bytes. Slots are grouped
+// by 16, and every slot has a control byte that is either empty, deleted, busy
+// (an insert is publishing it) or full, in which case it keeps 7 bits of the
+// key hash. A probe compares the control bytes of a whole group at once and
+// only looks at the elements whose fingerprint matches.
+//
+// Elements are immutable and live out of line, and removed ones are retired to
+// the master table exactly like chain nodes of HashTableImpl, so readers need
+// no lock of their own: the read-side critical section of the master table
+// keeps alive both the entries and the table they look at. Writers lock
+// the stripe of the group a key hashes to, which serializes updates of equal
+// keys, and claim free slots with CAS, because probe sequences of different
+// stripes overlap. Operations on the whole table exclude writers through
+// table_mutex_, which writers hold shared.
+template<typename Key, typename Value, typename Allocator, typename Table>
+class OpenAddressingHashTableImpl {
+ private:
+  struct Entry {
+    Entry(size_t hash, const Key& key, const Value& value)
+        : hash(hash), key(key), value(value) {}
+
+    size_t hash;
+    Key key;
+    Value value;
+  };
+
+  using EntryAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>;
+  using EntryTraits = std::allocator_traits<EntryAllocator>;
+
+  static constexpr size_t kGroupSize = 16;
+
+  static constexpr uint8_t kEmpty = 0x00;
+  static constexpr uint8_t kDeleted = 0x01;
+  static constexpr uint8_t kBusy = 0x02;
+  static constexpr uint8_t kFull = 0x80;
+
+  struct Group {
+    // Two words rather than 16 bytes, so that a group is read with two atomic
+    // loads and a slot is claimed with a CAS.
+    std::array<std::atomic<uint64_t>, 2> control;
+    std::array<std::atomic<Entry*>, kGroupSize> entries;
+
+    // Bit i of the result is set if the control byte of slot i is one of
+    // `first` or `second`.
+    uint32_t Match(uint8_t first, uint8_t second) const {
+      auto low = control[0].load(std::memory_order_acquire);
+      auto high = control[1].load(std::memory_order_acquire);
+#ifdef __SSE2__
+      auto bytes = _mm_set_epi64x(static_cast<long long>(high),
+                                  static_cast<long long>(low));
+      auto matches = _mm_or_si128(
+          _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(first))),
+          _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(second))));
+      return _mm_movemask_epi8(matches);
+#else
+      uint32_t mask = 0;
+      for (size_t i = 0; i < kGroupSize; i++) {
+        auto byte = static_cast<uint8_t>((i < 8 ? low : high) >> (i % 8 * 8));
+        if (byte == first || byte == second) {
+          mask |= 1u << i;
+        }
+      }
+      return mask;
+#endif
+    }
+
+    uint32_t Match(uint8_t byte) const { return Match(byte, byte); }
+
+    // Replaces the control byte of `slot` with `to` if it is currently one of
+    // `first` or `second`. Returns the replaced byte.
+    std::optional<uint8_t> ClaimControl(size_t slot, uint8_t first,
+                                        uint8_t second, uint8_t to) {
+      auto& word = control[slot / 8];
+      auto shift = slot % 8 * 8;
+      auto current = word.load();
+      while (true) {
+        auto byte = static_cast<uint8_t>(current >> shift);
+        if (byte != first && byte != second) {
+          return std::nullopt;
+        }
+        auto desired = (current & ~(uint64_t{0xFF} << shift)) |
+            (uint64_t{to} << shift);
+        if (word.compare_exchange_weak(current, desired)) {
+          return byte;
+        }
+      }
+    }
+
+    // Only the writer that owns a slot changes its control byte, other writers
+    // may concurrently change the rest of the word.
+    void ReplaceControl(size_t slot, uint8_t from, uint8_t to) {
+      control[slot / 8].fetch_xor(static_cast<uint64_t>(from ^ to)
+                                  << (slot % 8 * 8));
+    }
+  };
+
+  struct Position {
+    size_t group;
+    uint8_t fingerprint;
+  };
+
+  struct Found {
+    Group* group;
+    size_t slot;
+    Entry* entry;
+    // Set if a reader has to repeat the search in the new table, see Find.
+    bool moved = false;
+  };
+
+ public:
+  explicit OpenAddressingHashTableImpl(size_t bucket_count, Table* hash_table,
+                                       const Allocator& allocator,
+                                       bool construct_buckets = true)
+      : master_hash_table_(hash_table),
+        entry_allocator_(allocator),
+        bucket_count_(bucket_count),
+        group_count_(GroupCount(bucket_count)),
+        group_shift_(64 - Log2(group_count_)),
+        stripe_count_(std::min(group_count_, kMaxLockStripes)),
+        groups_(new Group[group_count_]),
+        stripes_(new std::mutex[stripe_count_]) {
+    if (construct_buckets) {
+      ConstructBuckets(group_count_);
+    }
+  }
+
+  ~OpenAddressingHashTableImpl() {
+    // Once moved, the elements belong to the new table.
+    if (moved_.load()) {
+      return;
+    }
+    for (size_t i = 0; i < constructed_group_count_; i++) {
+      for (auto& entry : groups_[i].entries) {
+        DeleteEntry(entry.load());
+      }
+    }
+  }
+
+  std::optional<bool> Insert(const Key& key, const Value& value) {
+    auto hash = hasher_(key);
+    auto position = GetPosition(hash);
+    std::shared_lock<std::shared_mutex> table_lock(table_mutex_);
+    std::unique_lock<std::mutex> lock(GetStripe(position));
+    if (moved_.load()) {
+      lock.unlock();
+      table_lock.unlock();
+      return new_table_.load()->Insert(key, value);
+    }
+
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    if (Find(key, hash, position, guard).entry != nullptr) {
+      return false;
+    }
+
+    auto* entry = EntryTraits::allocate(entry_allocator_, 1);
+    EntryTraits::construct(entry_allocator_, entry, hash, key, value);
+    if (!LinkEntry(entry, position)) {
+      DeleteEntry(entry);
+      return std::nullopt;
+    }
+    return true;
+  }
+
+  bool Remove(const Key& key) {
+    auto hash = hasher_(key);
+    auto position = GetPosition(hash);
+    std::shared_lock<std::shared_mutex> table_lock(table_mutex_);
+    std::unique_lock<std::mutex> lock(GetStripe(position));
+    if (moved_.load()) {
+      lock.unlock();
+      table_lock.unlock();
+      return new_table_.load()->Remove(key);
+    }
+
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    auto found = Find(key, hash, position, guard);
+    if (found.entry == nullptr) {
+      return false;
+    }
+    // The slot is freed last, so that no insert reuses it before the pointer
+    // is cleared.
+    found.group->entries[found.slot].store(nullptr);
+    found.group->ReplaceControl(found.slot, position.fingerprint, kDeleted);
+    master_hash_table_->Retire(found.entry);
+    return true;
+  }
+
+  bool Lookup(const Key& key, Value& value) {
+    if (moved_.load()) {
+      return new_table_.load()->Lookup(key, value);
+    }
+    auto hash = hasher_(key);
+    // The slot may be emptied concurrently, but the found entry stays alive
+    // as long as the guard.
+    typename Table::ReclamationGuard guard(master_hash_table_->lock_);
+    auto found = Find(key, hash, GetPosition(hash), guard);
+    if (found.moved) {
+      return new_table_.load()->Lookup(key, value);
+    }
+    if (found.entry == nullptr) {
+      return false;
+    }
+    value = found.entry->value;
+    return true;
+  }
+
+  // Requires that no resize is in progress.
+  size_t Clear() {
+    // Only readers are left.
+    std::unique_lock<std::shared_mutex> table_lock(table_mutex_);
+    size_t removed_count = 0;
+    int64_t used_slot_count = 0;
+    for (size_t i = 0; i < group_count_; i++) {
+      auto& group = groups_[i];
+      used_slot_count += kGroupSize - __builtin_popcount(group.Match(kEmpty));
+      group.control[0].store(kEmpty);
+      group.control[1].store(kEmpty);
+      for (auto& entry : group.entries) {
+        if (auto* removed = entry.exchange(nullptr)) {
+          master_hash_table_->Retire(removed);
+          ++removed_count;
+        }
+      }
+    }
+    used_slot_count_.Add(-used_slot_count, /*batch =*/ 0);
+    return removed_count;
+  }
+
+  // Requested capacity in elements; the table has at least 8/7 times more
+  // slots.
+  size_t BucketCount() const { return bucket_count_; }
+
+  // Deleted slots keep probe sequences intact, so they are only reclaimed by
+  // moving the elements to a new table of the same size.
+  bool NeedsRehash() {
+    return used_slot_count_.Total() * 8 >
+        static_cast<int64_t>(group_count_ * kGroupSize * 7);
+  }
+
+  // Groups are constructed in chunks of at most `max_group_count`.
+  bool ConstructBuckets(size_t max_group_count) {
+    auto end = constructed_group_count_ +
+        std::min(max_group_count, group_count_ - constructed_group_count_);
+    for (; constructed_group_count_ < end; constructed_group_count_++) {
+      auto& group = groups_[constructed_group_count_];
+      group.control[0].store(kEmpty, std::memory_order_relaxed);
+      group.control[1].store(kEmpty, std::memory_order_relaxed);
+      for (auto& entry : group.entries) {
+        entry.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    return constructed_group_count_ == group_count_;
+  }
+
+  OpenAddressingHashTableImpl* CreateNewHashTable(size_t new_bucket_count) {
+    return new OpenAddressingHashTableImpl(new_bucket_count,
+                                           master_hash_table_,
+                                           Allocator(entry_allocator_),
+                                           /*construct_buckets =*/ false);
+  }
+
+  bool IsReallocating() const { return new_table_.load() != nullptr; }
+
+  void StartReallocation(OpenAddressingHashTableImpl* new_table) {
+    new_table_.store(new_table);
+  }
+
+  // Any writer may probe any group, so unlike the chained table the elements
+  // are moved in one go, with writers excluded, whatever the step is.
+  bool ReallocateToNewHashTable(size_t /*max_bucket_count*/) {
+    std::unique_lock<std::shared_mutex> table_lock(table_mutex_);
+    auto* new_table = new_table_.load();
+    // The size of a shrink is chosen from a lagging element count, and
+    // writers kept inserting while the new table was constructed.
+    size_t element_count = 0;
+    for (size_t i = 0; i < group_count_; i++) {
+      for (auto& entry : groups_[i].entries) {
+        element_count += entry.load() != nullptr;
+      }
+    }
+    if (!new_table->CanHold(element_count)) {
+      new_table->Reinitialize(element_count * 2);
+    }
+    for (size_t i = 0; i < group_count_; i++) {
+      auto& group = groups_[i];
+      for (size_t slot = 0; slot < kGroupSize; slot++) {
+        auto* entry = group.entries[slot].load();
+        if (entry != nullptr) {
+          new_table->LinkEntry(entry, new_table->GetPosition(entry->hash));
+        }
+      }
+    }
+    // Readers that still look at this table see the entries that writers
+    // remove from the new one; those are retired to the master table too.
+    moved_.store(true);
+    return true;
+  }
+
+ private:
+  static constexpr size_t kMaxLockStripes = 256;
+
+  // Whether `element_count` elements stay below the rehash threshold.
+  bool CanHold(size_t element_count) const {
+    return element_count * 8 <= group_count_ * kGroupSize * 7;
+  }
+
+  // Replaces the groups of a table that is not published yet.
+  void Reinitialize(size_t bucket_count) {
+    bucket_count_ = bucket_count;
+    group_count_ = GroupCount(bucket_count);
+    group_shift_ = 64 - Log2(group_count_);
+    groups_.reset(new Group[group_count_]);
+    constructed_group_count_ = 0;
+    ConstructBuckets(group_count_);
+  }
+
+  static size_t Log2(size_t value) {
+    size_t result = 0;
+    while ((size_t{1} << result) < value) {
+      ++result;
+    }
+    return result;
+  }
+
+  // Power of two with at least 8/7 slots per requested element.
+  static size_t GroupCount(size_t bucket_count) {
+    auto slot_count = bucket_count + bucket_count / 7 + 1;
+    return size_t{1} << Log2((slot_count + kGroupSize - 1) / kGroupSize);
+  }
+
+  // Fibonacci hashing: std::hash of an integer is the identity, so the top
+  // bits of the product choose the group and the next 7 the fingerprint.
+  Position GetPosition(size_t hash) const {
+    auto mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    auto group = group_shift_ == 64 ? 0 : mixed >> group_shift_;
+    auto fingerprint = (mixed >> (group_shift_ - 7)) & 0x7F;
+    return {static_cast<size_t>(group),
+            static_cast<uint8_t>(kFull | fingerprint)};
+  }
+
+  std::mutex& GetStripe(Position position) {
+    return stripes_[position.group & (stripe_count_ - 1)];
+  }
+
+  // Visits the groups of the probe sequence of `position` until `visitor`
+  // returns true or every group is visited. Triangular steps visit every
+  // group of a power of two sized table.
+  template<typename Visitor>
+  bool Probe(Position position, Visitor visitor) {
+    auto group = position.group;
+    for (size_t i = 0; i < group_count_; i++) {
+      if (visitor(groups_[group])) {
+        return true;
+      }
+      group = (group + i + 1) & (group_count_ - 1);
+    }
+    return false;
+  }
+
+  // Must be called in a read-side critical section of the master table. The
+  // found entry, which other stripes may remove, stays alive as long as
+  // `guard`. A guard that protects single entries cannot see removals from
+  // the new table through the slots of this one, so once the table is moved
+  // an unlocked reader has to search the new table instead.
+  template<typename Guard>
+  Found Find(const Key& key, size_t hash, Position position, Guard& guard) {
+    Found found{nullptr, 0, nullptr};
+    Probe(position, [&](Group& group) {
+      for (auto slots = group.Match(position.fingerprint); slots != 0;
+           slots &= slots - 1) {
+        size_t slot = __builtin_ctz(slots);
+        auto* entry = guard.Protect(0, group.entries[slot]);
+        if (Guard::kValidates && moved_.load()) {
+          found.moved = true;
+          return true;
+        }
+        if (entry != nullptr && entry->hash == hash && entry->key == key) {
+          found = {&group, slot, entry};
+          return true;
+        }
+      }
+      // A slot never becomes empty again, so an element is never placed
+      // after an empty slot of its probe sequence.
+      return group.Match(kEmpty) != 0;
+    });
+    return found;
+  }
+
+  // Places `entry` into the first free slot of its probe sequence. Returns
+  // false if every slot is taken.
+  bool LinkEntry(Entry* entry, Position position) {
+    return Probe(position, [&](Group& group) {
+      for (auto slots = group.Match(kEmpty, kDeleted); slots != 0;
+           slots &= slots - 1) {
+        size_t slot = __builtin_ctz(slots);
+        auto claimed = group.ClaimControl(slot, kEmpty, kDeleted, kBusy);
+        if (!claimed) {
+          continue;
+        }
+        group.entries[slot].store(entry, std::memory_order_release);
+        group.ReplaceControl(slot, kBusy, position.fingerprint);
+        if (*claimed == kEmpty &&
+            used_slot_count_.Add(1, UsedSlotBatch()) && NeedsRehash()) {
+          master_hash_table_->NeedResize(bucket_count_);
+        }
+        return true;
+      }
+      return false;
+    });
+  }
+
+  void DeleteEntry(Entry* entry) {
+    if (entry != nullptr) {
+      EntryTraits::destroy(entry_allocator_, entry);
+      EntryTraits::deallocate(entry_allocator_, entry, 1);
+    }
+  }
+
+  int64_t UsedSlotBatch() const {
+    return std::clamp<int64_t>(group_count_, 1, 64);
+  }
+
+ private:
+  Table* const master_hash_table_;
+  EntryAllocator entry_allocator_;
+  // Only change before the table is published, see Reinitialize.
+  size_t bucket_count_;
+  size_t group_count_;
+  size_t group_shift_;
+  const size_t stripe_count_;
+  size_t constructed_group_count_ = 0;
+  std::unique_ptr<Group[]> groups_;
+  std::unique_ptr<std::mutex[]> stripes_;
+  std::shared_mutex table_mutex_;
+  std::hash<Key> hasher_;
+  // Slots that are full, busy or deleted.
+  ShardedCounter used_slot_count_;
+
+ private:
+  std::atomic<OpenAddressingHashTableImpl*> new_table_ = nullptr;
+  std::atomic<bool> moved_ = false;
+};
+
+}  // namespace hash_table_internals
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "thread_local.h"
+
+namespace rcu_lock_internal {
+
+template <typename T>
+class CopyableAtomic : public std::atomic<T> {
+ public:
+  using std::atomic<T>::atomic;
+
+  CopyableAtomic(const CopyableAtomic& rhs)
+      : std::atomic<T>::atomic(rhs.load()) {}
+};
+
+// Fences for a store-load ordering whose two sides run at very different
+// rates. Light() only stops the compiler, and Heavy() makes up for it with
+// membarrier, which runs a full barrier on every running thread of the
+// process. Without membarrier both sides use a full fence.
+class AsymmetricFence {
+ public:
+  static void Light() {
+    if (Expedited()) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } else {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  static void Heavy() {
+#ifdef __linux__
+    if (Expedited()) {
+      syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+      return;
+    }
+#endif
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+ private:
+  static bool Expedited() {
+    static const bool expedited = Register();
+    return expedited;
+  }
+
+  static bool Register() {
+#ifdef __linux__
+    return syscall(SYS_membarrier,
+                   MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
+  }
+};
+
+// Lets writers wait for a reader counter to change. A writer spins briefly,
+// then yields, then sleeps on a futex. Readers only pay for a load of
+// waiter_count_ on unlock, and a wake-up if a writer sleeps.
+class ReaderWaiter {
+ public:
+  // Returns once `counter` no longer holds `value`.
+  void WaitWhileEqual(const std::atomic<uint64_t>& counter, uint64_t value) {
+    for (size_t i = 0; i < kSpinCount; i++) {
+      if (counter.load() != value) {
+        return;
+      }
+      Pause();
+    }
+    for (size_t i = 0; i < kYieldCount; i++) {
+      if (counter.load() != value) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    waiter_count_.fetch_add(1);
+    // Pairs with the light fence of readers between their counter update and
+    // Notify.
+    AsymmetricFence::Heavy();
+    while (true) {
+      // Read before the counter: a reader that leaves afterwards changes it,
+      // so the futex does not sleep through the wake-up.
+      auto wake_count = wake_count_.load();
+      if (counter.load() != value) {
+        break;
+      }
+      FutexWait(wake_count);
+    }
+    waiter_count_.fetch_sub(1);
+  }
+
+  // Called by readers after they changed their counter and issued at least a
+  // light fence.
+  void Notify() {
+    if (waiter_count_.load(std::memory_order_relaxed) != 0) {
+      wake_count_.fetch_add(1);
+      FutexWakeAll();
+    }
+  }
+
+ private:
+  static constexpr size_t kSpinCount = 128;
+  static constexpr size_t kYieldCount = 16;
+
+  static void Pause() {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+  }
+
+  void FutexWait(uint32_t wake_count) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+            FUTEX_WAIT_PRIVATE, wake_count, nullptr, nullptr, 0);
+#else
+    (void)wake_count;
+    std::this_thread::yield();
+#endif
+  }
+
+  void FutexWakeAll() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+            FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+
+ private:
+  std::atomic<uint32_t> waiter_count_{0};
+  std::atomic<uint32_t> wake_count_{0};
+};
+
+}  // namespace rcu_lock_internal
+
+// Every thread keeps a counter that is odd inside a read-side critical
+// section. Synchronize waits until each counter that was odd has changed.
+// Only the owner writes a counter, so readers use plain stores; the store
+// that enters a critical section is ordered before its loads by an
+// asymmetric fence, whose expensive side Synchronize pays.
+class RCULock {
+ public:
+  void lock() { ReadLock(); }
+
+  void unlock() { ReadUnlock(); }
+
+  void ReadLock() {
+    auto& counter = *last_read_;
+    auto value = counter.load(std::memory_order_relaxed);
+    assert(value % 2 == 0);
+    counter.store(value + 1, std::memory_order_relaxed);
+    rcu_lock_internal::AsymmetricFence::Light();
+  }
+
+  void ReadUnlock() {
+    auto& counter = *last_read_;
+    auto value = counter.load(std::memory_order_relaxed);
+    assert(value % 2 == 1);
+    // Release: the loads of the critical section complete before a writer
+    // sees it end.
+    counter.store(value + 1, std::memory_order_release);
+    rcu_lock_internal::AsymmetricFence::Light();
+    waiter_.Notify();
+  }
+
+  // Concurrent callers share grace periods: a caller waits for the first
+  // grace period that starts after it arrives, which a single caller runs for
+  // everybody who arrived before it started.
+  void Synchronize() {
+    // grace_period_sequence_ is odd while a grace period runs. If one is
+    // running, it may have missed the critical sections this caller waits
+    // for, so the next one has to end.
+    auto target = (grace_period_sequence_.load() + 3) & ~uint64_t{1};
+    std::unique_lock<std::mutex> lock(grace_period_mutex_);
+    while (grace_period_sequence_.load() < target) {
+      grace_period_sequence_.fetch_add(1);
+      WaitForReaders();
+      grace_period_sequence_.fetch_add(1);
+    }
+  }
+
+ private:
+  // A critical section that started after the scan reached its thread does
+  // not have to be waited for, but it is harmless.
+  void WaitForReaders() {
+    // Either a reader's counter update is visible now, or the critical
+    // section it starts sees everything the caller stored before.
+    rcu_lock_internal::AsymmetricFence::Heavy();
+    for (auto& element : last_read_) {
+      auto timestamp = element.load();
+      if (timestamp & 1u) {
+        waiter_.WaitWhileEqual(element, timestamp);
+      }
+    }
+  }
+
+ private:
+  ThreadLocal<rcu_lock_internal::CopyableAtomic<uint64_t>> last_read_;
+  rcu_lock_internal::ReaderWaiter waiter_;
+  std::mutex grace_period_mutex_;
+  std::atomic<uint64_t> grace_period_sequence_{0};
+};
+
+// Read counters of the buckets are striped over a fixed number of slots, so
+// the memory a thread touches does not depend on the number of buckets.
+// Buckets of the same stripe share a counter: Synchronize(bucket) may also
+// wait for readers of the other buckets of its stripe.
+class RCUPerBucketLock {
+ public:
+  static constexpr size_t kDefaultStripeCount = 32;
+
+  explicit RCUPerBucketLock(size_t stripe_count = kDefaultStripeCount)
+      : stripe_count_(stripe_count), last_read_(stripe_count) {
+    assert(stripe_count > 0);
+  }
+
+  void lock(size_t bucket_number) { ReadLock(bucket_number); }
+
+  void unlock(size_t bucket_number) { ReadUnlock(bucket_number); }
+
+  void ReadLock(size_t bucket_number) {
+    auto& counter = (*last_read_)[Stripe(bucket_number)].value;
+    assert(counter % 2 == 0);
+    ++counter;
+  }
+
+  void ReadUnlock(size_t bucket_number) {
+    auto& counter = (*last_read_)[Stripe(bucket_number)].value;
+    assert(counter % 2 == 1);
+    ++counter;
+    waiter_.Notify();
+  }
+
+  void Synchronize(size_t bucket_number) {
+    auto stripe = Stripe(bucket_number);
+    for (auto& element : last_read_) {
+      auto& counter = element[stripe].value;
+      auto timestamp = counter.load();
+      if (timestamp & 1u) {
+        waiter_.WaitWhileEqual(counter, timestamp);
+      }
+    }
+  }
+
+ private:
+  // A cache line per stripe, so the counters of a thread never share a line
+  // with the counters of another.
+  struct alignas(64) Slot {
+    rcu_lock_internal::CopyableAtomic<uint64_t> value{0};
+  };
+
+  size_t Stripe(size_t bucket_number) const {
+    return bucket_number % stripe_count_;
+  }
+
+ private:
+  const size_t stripe_count_;
+  ThreadLocal<std::vector<Slot>> last_read_;
+  rcu_lock_internal::ReaderWaiter waiter_;
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace thread_local_internal {
+
+// Hands out slot indices to threads and takes them back when the threads
+// exit. The smallest free index is reused first, so indices stay below the
+// peak number of live threads, however many threads a pool has recycled.
+class SlotRegistry {
+ public:
+  static constexpr size_t kNoSlot = SIZE_MAX;
+
+  // Index of the calling thread.
+  static size_t CurrentSlot() {
+    auto& slot = Slot();
+    if (slot == kNoSlot) {
+      slot = Instance().Acquire();
+      // Constructed once per thread: a thread that touches a ThreadLocal
+      // after its releaser ran keeps the new index until the process exits.
+      static thread_local Releaser releaser;
+    }
+    return slot;
+  }
+
+ private:
+  struct Releaser {
+    ~Releaser() {
+      Instance().Release(Slot());
+      Slot() = kNoSlot;
+    }
+  };
+
+  // Never destroyed: threads may exit after every static object is gone.
+  static SlotRegistry& Instance() {
+    static auto* registry = new SlotRegistry();
+    return *registry;
+  }
+
+  // Trivially destructible, so it stays usable while other thread_local
+  // objects are destroyed.
+  static size_t& Slot() {
+    static thread_local size_t slot = kNoSlot;
+    return slot;
+  }
+
+  size_t Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_slots_.empty()) {
+      return slot_count_++;
+    }
+    auto slot = free_slots_.top();
+    free_slots_.pop();
+    return slot;
+  }
+
+  void Release(size_t slot) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    free_slots_.push(slot);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+      free_slots_;
+  size_t slot_count_ = 0;
+};
+
+}  // namespace thread_local_internal
+
+// A value per thread, indexed by the slot of the thread. A slot outlives its
+// thread: the next thread that is given the slot inherits the value, so
+// iterating visits at most as many values as there were live threads at once.
+template <typename T>
+class ThreadLocal {
+ private:
+  using SlotRegistry = thread_local_internal::SlotRegistry;
+
+  // Padded, so that values of different threads never share a cache line.
+  struct alignas(64) Slot {
+    std::atomic<bool> constructed{false};
+    std::optional<T> data;
+  };
+
+  // Segment i holds 2^i slots, so segments are never reallocated while other
+  // threads access them.
+  static constexpr size_t kSegmentCount = 32;
+
+ public:
+  template <typename... Args>
+  ThreadLocal(Args&&... args) : default_data_(std::forward<Args>(args)...) {}
+
+  ~ThreadLocal() {
+    for (auto& segment : segments_) {
+      delete[] segment.load();
+    }
+  }
+
+  T& operator*() { return *Get(); }
+
+  T* operator->() { return Get(); }
+
+  class Iterator {
+   public:
+    Iterator(ThreadLocal* thread_local_value, size_t index, size_t end_index)
+        : thread_local_(thread_local_value), index_(index),
+          end_index_(end_index) {
+      SkipUnconstructed();
+    }
+
+    T& operator*() const { return *thread_local_->FindSlot(index_)->data; }
+
+    T* operator->() const { return &*thread_local_->FindSlot(index_)->data; }
+
+    void operator++() {
+      ++index_;
+      SkipUnconstructed();
+    }
+
+    void operator++(int) { ++*this; }
+
+    bool operator!=(const Iterator& rhs) const { return index_ != rhs.index_; }
+
+   private:
+    void SkipUnconstructed() {
+      while (index_ < end_index_) {
+        auto* slot = thread_local_->FindSlot(index_);
+        if (slot != nullptr &&
+            slot->constructed.load(std::memory_order_acquire)) {
+          return;
+        }
+        ++index_;
+      }
+      index_ = SlotRegistry::kNoSlot;
+    }
+
+    ThreadLocal* thread_local_;
+    size_t index_;
+    size_t end_index_;
+  };
+
+  // Values of threads that start during the iteration may be skipped.
+  Iterator begin() { return Iterator(this, 0, slot_count_.load()); }
+
+  Iterator end() { return Iterator(this, SlotRegistry::kNoSlot, 0); }
+
+  // Resets the values of all threads. Must not run concurrently with any
+  // other access.
+  void clear() {
+    for (size_t i = 0; i < slot_count_.load(); i++) {
+      if (auto* slot = FindSlot(i)) {
+        slot->data.reset();
+        slot->constructed.store(false);
+      }
+    }
+  }
+
+ private:
+  static std::pair<size_t, size_t> Locate(size_t index) {
+    size_t segment = 63 - __builtin_clzll(index + 1);
+    return {segment, index + 1 - (size_t{1} << segment)};
+  }
+
+  // Returns nullptr if the segment of `index` is not allocated yet.
+  Slot* FindSlot(size_t index) {
+    auto [segment, offset] = Locate(index);
+    auto* slots = segments_[segment].load(std::memory_order_acquire);
+    return slots == nullptr ? nullptr : &slots[offset];
+  }
+
+  T* Get() {
+    auto index = SlotRegistry::CurrentSlot();
+    auto* slot = FindSlot(index);
+    if (slot == nullptr) {
+      slot = AllocateSlot(index);
+    }
+    // Only written by threads that held the slot before, which handed it over
+    // through the registry.
+    if (!slot->constructed.load(std::memory_order_relaxed)) {
+      Construct(*slot, index);
+    }
+    return &*slot->data;
+  }
+
+  Slot* AllocateSlot(size_t index) {
+    auto [segment, offset] = Locate(index);
+    assert(segment < kSegmentCount);
+    auto* slots = new Slot[size_t{1} << segment];
+    Slot* expected = nullptr;
+    if (!segments_[segment].compare_exchange_strong(expected, slots)) {
+      delete[] slots;
+      slots = expected;
+    }
+    return &slots[offset];
+  }
+
+  void Construct(Slot& slot, size_t index) {
+    slot.data.emplace(default_data_);
+    slot.constructed.store(true, std::memory_order_release);
+    auto slot_count = slot_count_.load();
+    while (slot_count <= index &&
+           !slot_count_.compare_exchange_weak(slot_count, index + 1)) {
+    }
+  }
+
+  std::array<std::atomic<Slot*>, kSegmentCount> segments_{};
+  // One more than the largest index of a constructed slot.
+  std::atomic<size_t> slot_count_{0};
+  T default_data_;
+};
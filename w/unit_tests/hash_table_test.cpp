@@ -0,0 +1,338 @@
+#include "hash_table.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CountedKey {
+  int value;
+
+  bool operator==(const CountedKey& rhs) const { return value == rhs.value; }
+};
+
+std::atomic<size_t> counted_key_hash_calls{0};
+
+std::atomic<int64_t> live_allocations{0};
+
+// Stands in for an arena: counts the blocks it hands out.
+template<typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+
+  template<typename U>
+  CountingAllocator(const CountingAllocator<U>& /*other*/) {}
+
+  T* allocate(size_t n) {
+    live_allocations.fetch_add(n);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* pointer, size_t n) {
+    live_allocations.fetch_sub(n);
+    std::allocator<T>().deallocate(pointer, n);
+  }
+
+  template<typename U>
+  bool operator==(const CountingAllocator<U>& /*other*/) const { return true; }
+
+  template<typename U>
+  bool operator!=(const CountingAllocator<U>& /*other*/) const { return false; }
+};
+
+}  // namespace
+
+namespace std {
+
+template <>
+struct hash<CountedKey> {
+  size_t operator()(const CountedKey& key) const {
+    counted_key_hash_calls.fetch_add(1);
+    return hash<int>()(key.value);
+  }
+};
+
+}  // namespace std
+
+TEST(HashTable, API) {
+  HashTable<std::string, std::string> ht(1);
+
+  std::string value;
+  ASSERT_FALSE(ht.Lookup("key", value));
+  ASSERT_TRUE(ht.Insert("key", "value"));
+  ASSERT_TRUE(ht.Lookup("key", value));
+  ASSERT_EQ(value, "value");
+  ASSERT_TRUE(ht.Remove("key"));
+  ASSERT_FALSE(ht.Lookup("key", value));
+}
+
+TEST(HashTable, RemoveAbsent) {
+  HashTable<std::string, std::string> ht(3);
+  ASSERT_FALSE(ht.Remove("NotFound"));
+}
+
+TEST(HashTable, Overwrite) {
+  HashTable<std::string, std::string> ht(7);
+
+  ASSERT_TRUE(ht.Insert("key", "old"));
+  ASSERT_TRUE(ht.Remove("key"));
+  ASSERT_TRUE(ht.Insert("key", "new"));
+
+  std::string value;
+  ASSERT_TRUE(ht.Lookup("key", value));
+  ASSERT_EQ(value, "new");
+}
+
+TEST(HashTable, RepeatedUpdates) {
+  HashTable<int, std::string> ht(17);
+  ASSERT_TRUE(ht.Insert(1, "One"));
+  ASSERT_FALSE(ht.Insert(1, "Two"));
+
+  std::string value;
+  ASSERT_TRUE(ht.Lookup(1, value));
+  ASSERT_EQ(value, "One");
+
+  ASSERT_TRUE(ht.Remove(1));
+  ASSERT_FALSE(ht.Remove(1));
+
+  ASSERT_FALSE(ht.Lookup(1, value));
+}
+
+TEST(HashTable, MultipleKeys) {
+  HashTable<std::string, int> ht(3);
+
+  const int kRange = 17;
+
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Insert(std::to_string(i), i));
+  }
+
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    if (i % 2 == 0) {
+      ASSERT_TRUE(ht.Lookup(std::to_string(i), value));
+      ASSERT_EQ(value, i);
+      ASSERT_TRUE(ht.Remove(std::to_string(i)));
+    } else {
+      ASSERT_FALSE(ht.Lookup(std::to_string(i), value));
+    }
+  }
+
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_FALSE(ht.Lookup(std::to_string(i), value));
+  }
+}
+
+TEST(HashTable, IncrementalResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  options.incremental_resize_step = 1;
+  HashTable<int, int> ht(1, options);
+
+  const int kRange = 1000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    for (int j = 0; j <= i; j += 7) {
+      int value;
+      ASSERT_TRUE(ht.Lookup(j, value));
+      ASSERT_EQ(value, j);
+    }
+  }
+
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i % 2 == 1);
+  }
+}
+
+TEST(HashTable, ClearDuringIncrementalResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kIncremental;
+  HashTable<int, int> ht(1, options);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  ht.Clear();
+
+  for (int i = 0; i < 100; ++i) {
+    int value;
+    ASSERT_FALSE(ht.Lookup(i, value));
+  }
+  ASSERT_TRUE(ht.Insert(1, 1));
+}
+
+TEST(HashTable, BackgroundResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  HashTable<int, int> ht(1, options);
+
+  const int kRange = 10000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+    ASSERT_TRUE(ht.Remove(i));
+  }
+}
+
+TEST(HashTable, DestroyDuringBackgroundResize) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  options.incremental_resize_step = 1;
+
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    HashTable<int, std::string> ht(1, options);
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_TRUE(ht.Insert(i, std::to_string(i)));
+    }
+  }
+}
+
+TEST(HashTable, ShrinkAfterDrain) {
+  HashTable<int, int> ht(1);
+
+  const int kRange = 10000;
+  const int kKept = 10;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = kKept; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i < kKept);
+  }
+  for (int i = kKept; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+}
+
+TEST(HashTable, Size) {
+  HashTable<int, int> ht(1);
+  ASSERT_EQ(ht.Size(), 0);
+
+  const int kRange = 1000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    ASSERT_FALSE(ht.Insert(i, i));
+  }
+  ASSERT_EQ(ht.Size(), kRange);
+
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  ASSERT_EQ(ht.Size(), kRange / 2);
+
+  ht.Clear();
+  ASSERT_EQ(ht.Size(), 0);
+}
+
+TEST(HashTable, SizeFromDifferentThreads) {
+  HashTable<int, int> ht(1);
+
+  const int kThreads = 8;
+  const int kKeysPerThread = 1000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&ht, t] {
+      for (int i = 0; i < kKeysPerThread; ++i) {
+        ASSERT_TRUE(ht.Insert(t * kKeysPerThread + i, i));
+      }
+      for (int i = 0; i < kKeysPerThread; i += 4) {
+        ASSERT_TRUE(ht.Remove(t * kKeysPerThread + i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(ht.Size(), kThreads * kKeysPerThread * 3 / 4);
+}
+
+TEST(HashTable, HashIsComputedOncePerOperation) {
+  HashTable<CountedKey, int> ht(1);
+  counted_key_hash_calls = 0;
+
+  const int kRange = 1000;
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert({i}, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup({i}, value));
+    ASSERT_TRUE(ht.Remove({i}));
+  }
+
+  // Resizes reuse the cached hashes.
+  ASSERT_EQ(counted_key_hash_calls.load(), 3 * kRange);
+}
+
+template<typename Backend, typename Reclamation = RCUReclamation>
+void CheckCustomAllocator() {
+  const int kRange = 1000;
+  {
+    HashTable<int, int, Backend, CountingAllocator<std::pair<const int, int>>,
+              Reclamation> ht(1);
+    for (int i = 0; i < kRange; ++i) {
+      ASSERT_TRUE(ht.Insert(i, i));
+    }
+    ASSERT_EQ(live_allocations.load(), kRange);
+    for (int i = 0; i < kRange; i += 2) {
+      ASSERT_TRUE(ht.Remove(i));
+    }
+    // Removed nodes are freed once their grace period is over.
+    ASSERT_GE(live_allocations.load(), kRange / 2);
+  }
+  ASSERT_EQ(live_allocations.load(), 0);
+}
+
+TEST(HashTable, CustomAllocator) {
+  CheckCustomAllocator<ChainingBackend>();
+  CheckCustomAllocator<OpenAddressingBackend>();
+}
+
+TEST(HashTable, ReclamationPolicies) {
+  CheckCustomAllocator<ChainingBackend, EpochReclamation>();
+  CheckCustomAllocator<ChainingBackend, HazardPointerReclamation>();
+  CheckCustomAllocator<OpenAddressingBackend, EpochReclamation>();
+  CheckCustomAllocator<OpenAddressingBackend, HazardPointerReclamation>();
+}
+
+TEST(HashTable, ManyRemovesWithSlowReader) {
+  HashTable<int, int> ht(1);
+
+  const int kRange = 100000;
+
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    while (!done.load()) {
+      int value;
+      ht.Lookup(0, value);
+      std::this_thread::yield();
+    }
+  });
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  done = true;
+  reader.join();
+  ASSERT_EQ(ht.Size(), 0);
+}
@@ -0,0 +1,116 @@
+#include "hash_table.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+template<typename Key, typename Value>
+using OpenAddressingHashTable = HashTable<Key, Value, OpenAddressingBackend>;
+
+TEST(OpenAddressingHashTable, API) {
+  OpenAddressingHashTable<std::string, std::string> ht(1);
+
+  std::string value;
+  ASSERT_FALSE(ht.Lookup("key", value));
+  ASSERT_TRUE(ht.Insert("key", "value"));
+  ASSERT_FALSE(ht.Insert("key", "other"));
+  ASSERT_TRUE(ht.Lookup("key", value));
+  ASSERT_EQ(value, "value");
+  ASSERT_TRUE(ht.Remove("key"));
+  ASSERT_FALSE(ht.Remove("key"));
+  ASSERT_FALSE(ht.Lookup("key", value));
+}
+
+TEST(OpenAddressingHashTable, Growth) {
+  OpenAddressingHashTable<int, int> ht(1);
+
+  const int kRange = 10000;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  ASSERT_EQ(ht.Size(), kRange);
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+  for (int i = 0; i < kRange; i += 2) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    int value;
+    ASSERT_EQ(ht.Lookup(i, value), i % 2 == 1);
+  }
+}
+
+// Deleted slots are only reclaimed by a rehash, so a table whose size stays
+// small but whose keys keep changing must not run out of slots.
+TEST(OpenAddressingHashTable, ChurnWithoutGrowth) {
+  HashTableOptions options;
+  options.min_load_factor = 0;
+  OpenAddressingHashTable<int, int> ht(64, options);
+
+  const int kRange = 100000;
+  const int kLive = 32;
+
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+    if (i >= kLive) {
+      ASSERT_TRUE(ht.Remove(i - kLive));
+    }
+  }
+  for (int i = kRange - kLive; i < kRange; ++i) {
+    int value;
+    ASSERT_TRUE(ht.Lookup(i, value));
+    ASSERT_EQ(value, i);
+  }
+  ASSERT_EQ(ht.Size(), kLive);
+}
+
+TEST(OpenAddressingHashTable, Clear) {
+  OpenAddressingHashTable<int, std::string> ht(16);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(ht.Insert(i, std::to_string(i)));
+  }
+  ht.Clear();
+  ASSERT_EQ(ht.Size(), 0);
+
+  for (int i = 0; i < 100; ++i) {
+    std::string value;
+    ASSERT_FALSE(ht.Lookup(i, value));
+    ASSERT_TRUE(ht.Insert(i, std::to_string(-i)));
+  }
+}
+
+TEST(OpenAddressingHashTable, LookupsDuringResizes) {
+  HashTableOptions options;
+  options.resize_mode = ResizeMode::kBackground;
+  OpenAddressingHashTable<int, int> ht(1, options);
+
+  const int kStable = 100;
+  const int kRange = 20000;
+
+  for (int i = 0; i < kStable; ++i) {
+    ASSERT_TRUE(ht.Insert(-i - 1, i));
+  }
+
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    while (!done.load()) {
+      for (int i = 0; i < kStable; ++i) {
+        int value;
+        ASSERT_TRUE(ht.Lookup(-i - 1, value));
+        ASSERT_EQ(value, i);
+      }
+    }
+  });
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Insert(i, i));
+  }
+  for (int i = 0; i < kRange; ++i) {
+    ASSERT_TRUE(ht.Remove(i));
+  }
+  done = true;
+  reader.join();
+}
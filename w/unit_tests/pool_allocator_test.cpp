@@ -0,0 +1,71 @@
+#include "pool_allocator.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Block {
+  char data[40];
+};
+
+}  // namespace
+
+TEST(PoolAllocator, ReusesFreedBlocks) {
+  PoolAllocator<Block> allocator;
+
+  auto* first = allocator.allocate(1);
+  allocator.deallocate(first, 1);
+  auto* second = allocator.allocate(1);
+  ASSERT_EQ(first, second);
+  allocator.deallocate(second, 1);
+}
+
+TEST(PoolAllocator, BlocksAreDistinct) {
+  PoolAllocator<Block> allocator;
+  const size_t kBlocks = 1000;
+
+  std::vector<Block*> blocks;
+  std::set<Block*> unique_blocks;
+  for (size_t i = 0; i < kBlocks; ++i) {
+    blocks.push_back(allocator.allocate(1));
+    unique_blocks.insert(blocks.back());
+    blocks.back()->data[0] = static_cast<char>(i);
+  }
+  ASSERT_EQ(unique_blocks.size(), kBlocks);
+
+  for (size_t i = 0; i < kBlocks; ++i) {
+    ASSERT_EQ(blocks[i]->data[0], static_cast<char>(i));
+    allocator.deallocate(blocks[i], 1);
+  }
+}
+
+TEST(PoolAllocator, Arrays) {
+  PoolAllocator<int> allocator;
+
+  auto* array = allocator.allocate(100);
+  for (int i = 0; i < 100; ++i) {
+    array[i] = i;
+  }
+  ASSERT_EQ(array[99], 99);
+  allocator.deallocate(array, 100);
+}
+
+TEST(PoolAllocator, FreeOnAnotherThread) {
+  PoolAllocator<Block> allocator;
+  const size_t kBlocks = 10000;
+
+  for (int round = 0; round < 10; ++round) {
+    std::vector<Block*> blocks;
+    for (size_t i = 0; i < kBlocks; ++i) {
+      blocks.push_back(allocator.allocate(1));
+    }
+    std::thread remover([&] {
+      for (auto* block : blocks) {
+        allocator.deallocate(block, 1);
+      }
+    });
+    remover.join();
+  }
+}
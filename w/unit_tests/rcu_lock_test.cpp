@@ -0,0 +1,146 @@
+#include "rcu_lock.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <random>
+
+TEST(RCULock, SynchronizeWithReaders) {
+  const size_t kReaders = 17;
+  const int32_t kMinSleep = 100;
+  const int32_t kMaxSleep = 1000;
+
+  RCULock rcu_lock;
+
+  std::atomic<size_t> readers_completed{0};
+
+  auto reader_routine = [&]() {
+    std::random_device rd;
+    std::mt19937 mt(rd());
+    std::uniform_int_distribution<int> distribution(kMinSleep, kMaxSleep);
+
+    rcu_lock.ReadLock();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(distribution(mt)));
+
+    readers_completed.fetch_add(1);
+
+    rcu_lock.ReadUnlock();
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(kReaders);
+  for (size_t i = 0; i < kReaders; ++i) {
+    threads.emplace_back(reader_routine);
+  }
+  for (size_t i = 0; i < kReaders; i++) {
+    threads[i].join();
+  }
+
+  rcu_lock.Synchronize();
+  ASSERT_EQ(readers_completed.load(), kReaders);
+}
+
+TEST(RCULock, ConcurrentSynchronize) {
+  const size_t kReaders = 4;
+  const size_t kWriters = 4;
+  const size_t kIterations = 1000;
+
+  RCULock rcu_lock;
+  std::atomic<int*> data{new int(0)};
+  std::atomic<bool> stopped{false};
+
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < kReaders; ++i) {
+    readers.emplace_back([&] {
+      while (!stopped.load()) {
+        std::unique_lock<RCULock> lock(rcu_lock);
+        ASSERT_GE(*data.load(), 0);
+      }
+    });
+  }
+
+  // Every writer frees what it replaced, so a grace period shared by several
+  // writers must still cover the readers of each of them.
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < kWriters; ++i) {
+    writers.emplace_back([&] {
+      for (size_t j = 0; j < kIterations; ++j) {
+        auto* old_data = data.exchange(new int(j));
+        rcu_lock.Synchronize();
+        delete old_data;
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  stopped = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  delete data.load();
+}
+
+TEST(RCUPerBucketLock, SynchronizeWaitsForReadersOfStripe) {
+  const size_t kStripes = 4;
+  const size_t kBuckets = 1000;
+
+  RCUPerBucketLock rcu_lock(kStripes);
+
+  std::atomic<bool> locked{false};
+  std::atomic<bool> unlocked{false};
+  std::thread reader([&] {
+    rcu_lock.ReadLock(kBuckets - 1);
+    locked = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    unlocked = true;
+    rcu_lock.ReadUnlock(kBuckets - 1);
+  });
+  while (!locked.load()) {
+    std::this_thread::yield();
+  }
+
+  rcu_lock.Synchronize((kBuckets - 1) % kStripes);
+  ASSERT_TRUE(unlocked.load());
+  reader.join();
+}
+
+//struct Data {
+//  std::atomic<size_t> value = 0;
+//  RCULock lock;
+//};
+//
+//TEST(RCULock, InnerLocks) {
+//  const size_t kReaders = 17;
+//  const int32_t kMinSleep = 100;
+//  const int32_t kMaxSleep = 1000;
+//
+//  RCULock data_lock;
+//  auto* data = new Data();
+//  auto* data_replace = new Data();
+//
+//  auto reader_routine = [&]() {
+//    std::random_device rd;
+//    std::mt19937 mt(rd());
+//    std::uniform_int_distribution<int> distribution(kMinSleep, kMaxSleep);
+//
+//    std::this_thread::sleep_for(std::chrono::milliseconds(distribution(mt)));
+//
+//    std::unique_lock lock(data_lock);
+//
+//    ++
+//  };
+//
+//  std::vector<std::thread> threads;
+//  threads.reserve(kReaders);
+//  for (size_t i = 0; i < kReaders; ++i) {
+//    threads.emplace_back(reader_routine);
+//  }
+//  for (size_t i = 0; i < kReaders; i++) {
+//    threads[i].join();
+//  }
+//
+//
+//  ASSERT_EQ(value.load(), kReaders);
+//}
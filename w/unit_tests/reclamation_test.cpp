@@ -0,0 +1,78 @@
+#include "reclamation.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void CountReclaimed(void* counter, void* /*object*/) {
+  ++*static_cast<size_t*>(counter);
+}
+
+void RecordReclaimed(void* reclaimed, void* object) {
+  static_cast<std::vector<void*>*>(reclaimed)->push_back(object);
+}
+
+}  // namespace
+
+TEST(EpochDomain, ReaderHoldsBackReclamation) {
+  const size_t kRetired = 1000;
+  size_t reclaimed = 0;
+  std::vector<int> objects(2 * kRetired);
+  {
+    hash_table_internals::EpochDomain domain;
+    {
+      std::unique_lock<hash_table_internals::EpochDomain> lock(domain);
+      for (size_t i = 0; i < kRetired; ++i) {
+        domain.Retire({&objects[i], &CountReclaimed, &reclaimed});
+      }
+      ASSERT_EQ(reclaimed, 0);
+    }
+    for (size_t i = kRetired; i < 2 * kRetired; ++i) {
+      domain.Retire({&objects[i], &CountReclaimed, &reclaimed});
+    }
+    ASSERT_GE(reclaimed, kRetired);
+  }
+  ASSERT_EQ(reclaimed, 2 * kRetired);
+}
+
+TEST(EpochDomain, SynchronizeWaitsForReaders) {
+  hash_table_internals::EpochDomain domain;
+  std::atomic<bool> locked = false;
+  std::atomic<bool> unlocked = false;
+  std::thread reader([&] {
+    std::unique_lock<hash_table_internals::EpochDomain> lock(domain);
+    locked = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    unlocked = true;
+  });
+  while (!locked.load()) {
+    std::this_thread::yield();
+  }
+  domain.Synchronize();
+  ASSERT_TRUE(unlocked.load());
+  reader.join();
+}
+
+TEST(HazardPointerDomain, ProtectedObjectIsNotReclaimed) {
+  const size_t kRetired = 1000;
+  std::vector<void*> reclaimed;
+  std::vector<int> objects(kRetired);
+  std::atomic<int*> source = &objects[0];
+  {
+    hash_table_internals::HazardPointerDomain domain;
+    {
+      hash_table_internals::HazardPointerDomain::Guard guard(domain);
+      ASSERT_EQ(guard.Protect(0, source), &objects[0]);
+      for (size_t i = 0; i < kRetired; ++i) {
+        domain.Retire({&objects[i], &RecordReclaimed, &reclaimed});
+      }
+      ASSERT_GE(reclaimed.size(), kRetired / 2);
+      ASSERT_EQ(std::count(reclaimed.begin(), reclaimed.end(), &objects[0]), 0);
+    }
+  }
+  ASSERT_EQ(reclaimed.size(), kRetired);
+}
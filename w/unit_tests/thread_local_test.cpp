@@ -0,0 +1,127 @@
+#include "thread_local.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+TEST(ThreadLocal, SetAndGet) {
+  ThreadLocal<int> tl;
+  *tl = 42;
+  ASSERT_EQ(*tl, 42);
+
+  ThreadLocal<int> tl_other;
+  *tl_other = 17;
+  ASSERT_EQ(*tl_other, 17);
+
+  ASSERT_EQ(*tl, 42);
+}
+
+TEST(ThreadLocal, AccessFromDifferentThreads) {
+  ThreadLocal<std::string> tl;
+
+  *tl = "first";
+  ASSERT_EQ(*tl, "first");
+
+  std::thread other_thread([&tl]() {
+    *tl = "second";
+    ASSERT_EQ(*tl, "second");
+  });
+
+  other_thread.join();
+
+  ASSERT_EQ(*tl, "first");
+}
+
+TEST(ThreadLocal, AccessManyTimes) {
+  ThreadLocal<int> tl;
+  const size_t kAccesses = 100500;
+  for (size_t i = 0; i <= kAccesses; ++i) {
+    *tl = i;
+  }
+  ASSERT_EQ(*tl, kAccesses);
+}
+
+TEST(ThreadLocal, IterateThreadLocalValues) {
+  ThreadLocal<int> tl;
+
+  static const size_t kThreads = 10;
+  std::atomic<size_t> passed_threads{0};
+
+  auto accessor = [&tl, &passed_threads](int thread_index) {
+    *tl = thread_index;
+
+    passed_threads.fetch_add(1);
+    while (passed_threads.load() < kThreads) {
+      std::this_thread::yield();
+    }
+
+    size_t total = 0;
+    size_t thread_count = 0;
+
+    for (auto& value : tl) {
+      ++thread_count;
+      total += value;
+    }
+
+    ASSERT_EQ(thread_count, kThreads);
+    ASSERT_EQ(total, kThreads * (kThreads - 1) / 2);
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(kThreads);
+  for (size_t i = 0; i < kThreads; ++i) {
+    threads.emplace_back(accessor, i);
+  }
+  for (size_t i = 0; i < kThreads; i++) {
+    threads[i].join();
+  }
+}
+
+TEST(ThreadLocal, IterateThreadLocalCounters) {
+  static const size_t kThreads = 10;
+  ThreadLocal<size_t> tl;
+  std::atomic<size_t> started_threads{0};
+
+  // No thread exits before every thread has taken a slot, so none of them
+  // inherits the counter of another.
+  auto accessor = [&tl, &started_threads]() {
+    ++(*tl);
+    ASSERT_EQ(*tl, 1);
+    started_threads.fetch_add(1);
+    while (started_threads.load() < kThreads) {
+      std::this_thread::yield();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreads; i++) {
+    threads.emplace_back(accessor);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  size_t total = 0;
+  for (auto thread_local_value : tl) {
+    total += thread_local_value;
+  }
+  ASSERT_EQ(total, kThreads);
+}
+
+TEST(ThreadLocal, SlotsOfExitedThreadsAreReused) {
+  static const size_t kThreads = 1000;
+  ThreadLocal<size_t> tl;
+
+  for (size_t i = 0; i < kThreads; i++) {
+    std::thread([&tl] { ++(*tl); }).join();
+  }
+
+  size_t slot_count = 0;
+  size_t total = 0;
+  for (auto value : tl) {
+    ++slot_count;
+    total += value;
+  }
+  ASSERT_LT(slot_count, 10);
+  ASSERT_EQ(total, kThreads);
+}